@@ -1,5 +1,8 @@
 #include "ControllerSystems.h"
 
+#include <utility>
+
+#include "CoreSystems.h"
 #include "debug.h"
 #include "input.h"
 
@@ -10,9 +13,10 @@ void EnemyFollowTargetSystem::Update(const GameTime& time)
 
 	const auto& targetTransform = GetWorld().GetComponent<Transform>(targetEntity);
 
-	for (Entity entity : GetEntities())
+	auto [first, last] = GetSliceRange();
+	for (QueryBase::Index index = first; index < last; ++index)
 	{
-		auto [transform, velocity, _] = GetArchetype(entity);
+		auto [transform, velocity, _] = GetArchetypeAtIndex(index);
 
 		Vec2 delta = targetTransform.position - transform.position;
 		Vec2 dir = vec2::Normalize(delta);
@@ -44,9 +48,12 @@ void GameCameraControlSystem::Update(const GameTime& time)
 
 		if (camera.followTarget)
 		{
+			// The target is followed where it is drawn so it doesn't jitter against the view when several ticks run in a frame
 			const auto& targetTransform = GetWorld().GetComponent<Transform>(camera.followTarget);
+			const PreviousTransform* targetPrevious = GetWorld().TryGetComponent<PreviousTransform>(camera.followTarget);
+			Vec2 targetPosition = TransformHistorySystem::InterpolatePosition(targetTransform.position, targetPrevious, time.alpha());
 
-			auto [dx, dy] = targetTransform.position - view.center;
+			auto [dx, dy] = targetPosition - view.center;
 
 			if (dx < camera.followBounds.Left())
 				transform.position.x += dx - camera.followBounds.Left();
@@ -157,19 +164,77 @@ void PlayerShootControlSystem::Update(const GameTime& time)
 					flags = SpriteFlipFlags::FlipY;
 					break;
 				}
-				Entity bulletEntity = GetWorld().CreateEntity();
-				GetWorld().AddComponents(bulletEntity,
-					Transform{ {transform.position} },
-					Velocity{ bulletVel },
-					PhysicsBody{},
-					Facing{ facing.facing },
-					SpriteRender{ 14	, flags, vec2::Half },
-					Expiration{ 1.0f });
+				Entity bulletEntity = GetWorld().Acquire(shootControl.bulletPrefab);
+				auto [bulletTransform, bulletVelocity, bulletFacing, bulletSprite] =
+					GetWorld().GetComponents<Transform, Velocity, Facing, SpriteRender>(bulletEntity);
+				bulletTransform.position = transform.position;
+				bulletVelocity.velocity = bulletVel;
+				bulletFacing.facing = facing.facing;
+				bulletSprite.flipFlags = flags;
 			}
 		}
 	}
 }
 
+void BulletSystem::Update(const GameTime& time)
+{
+	if (!physicsSystem)
+		return;
+
+	const std::vector<Entity>& entities = GetEntities();
+	rays.resize(entities.size());
+	hits.resize(entities.size());
+	for (QueryBase::Index index = 0; index < std::ssize(entities); ++index)
+	{
+		auto [bullet, transform, body] = GetArchetypeAtIndex(index);
+		rays[index] = Ray{ transform.position, body.velocity, vec2::Length(body.velocity) };
+	}
+
+	physicsSystem->Raycast(rays, hits);
+
+	for (QueryBase::Index index = 0; index < std::ssize(entities); ++index)
+	{
+		if (hits[index].hit)
+			Despawn(entities[index]);
+	}
+}
+
+// A bullet stops at its first enemy and an enemy dies once however many bullets reached it in the same tick.
+// A bullet that hit a wall this tick is still released at the end of the stage, its overlaps from this tick still count.
+void BulletSystem::ResolveHits()
+{
+	if (!collisionSystem)
+		return;
+
+	World& world = GetWorld();
+
+	spentBullets.clear();
+	killedEnemies.clear();
+	for (const TriggerBegin& overlap : collisionSystem->GetTriggerBegins())
+	{
+		if (!world.HasComponent<BulletTag>(overlap.trigger) || !world.HasComponent<EnemyTag>(overlap.other))
+			continue;
+
+		if (spentBullets.contains(overlap.trigger) || !killedEnemies.insert(overlap.other).second)
+			continue;
+
+		spentBullets.insert(overlap.trigger);
+		Despawn(overlap.trigger);
+
+		const SpawnSource* spawnSource = world.TryGetComponent<SpawnSource>(overlap.other);
+		world.Events<EnemyKilled>().Send({ overlap.other, spawnSource ? spawnSource->source : 0 });
+		world.DeferDestroyEntity(overlap.other);
+	}
+}
+
+void BulletSystem::Despawn(Entity bullet)
+{
+	if (GetWorld().HasComponent<Pooled>(bullet))
+		GetWorld().DeferRelease(bullet);
+	else
+		GetWorld().DeferDestroyEntity(bullet);
+}
+
 namespace spawner
 {
 	Entity Spawn(World& world, const Spawner& spawner, Vec2 position, float rotation)
@@ -178,7 +243,7 @@ namespace spawner
 		{
 			if (world.HasComponent<Transform>(spawned))
 			{
-				auto& transform = world.GetComponent<Transform>(spawned);
+				auto transform = world.GetComponent<Transform>(spawned);
 				transform.position = position;
 				transform.rotation = rotation;
 			}
@@ -199,18 +264,7 @@ void SpawnerSystem::OnRegistered()
 			auto& [sourceB] = world.GetComponent<SpawnSource>(b);
 			return sourceA < sourceB || ((sourceA == sourceB) ? a < b : false);*/
 	//SortedQuery<Reject<Prefab>, SpawnSource, Transform>::SortPredicate
-	spawnSourceQuery = GetWorld().CreateQuery<Reject<Prefab>, SpawnSource, Transform>(
-		QueryCallbacks{
-			.onEntityMatch = {},
-			.onEntityUnmatch = [this](Entity e)
-			{
-				auto [source] = GetWorld().GetComponent<SpawnSource>(e);
-				for (Entity entity : GetEntities())
-				{
-					if (entity == source)
-						GetWorld().GetComponent<Spawner>(entity).spawnedEnemies--;
-				}}
-		});
+	spawnSourceQuery = GetWorld().CreateQuery<Reject<Prefab>, SpawnSource, Transform>();
 }
 
 
@@ -246,8 +300,25 @@ void SpawnerSystem::Update(const GameTime& time)
 		}
 
 	}
+}
+
+// Key presses are only visible for the frame they happen in while fixed ticks can run any number of times per frame, so they are latched here
+void SpawnerSystem::GatherInput()
+{
+	if (input::GetKeyDown(SDL_SCANCODE_K))
+		killRequested = true;
+}
+
+// Events are only visible for a single tick so these can't be handled by the reduced rate Update
+void SpawnerSystem::UpdateKills(const GameTime& time)
+{
+	for (const EnemyKilled& killed : GetWorld().Events<EnemyKilled>().Read())
+	{
+		if (Spawner* spawner = killed.source ? GetWorld().TryGetComponent<Spawner>(killed.source) : nullptr)
+			spawner->spawnedEnemies--;
+	}
 
-	if (!GetEntities().empty() && input::GetKeyDown(SDL_SCANCODE_K))
+	if (std::exchange(killRequested, false) && !GetEntities().empty())
 	{
 		static int s_kill = 1;
 		debug::Log("KILL {}", s_kill++);
@@ -265,7 +336,8 @@ void SpawnerSystem::Update(const GameTime& time)
 			if (sources[i].get().source == entity)
 			{
 				debug::Log("Destroying {} with source {}", spawnedEntity, sources[i].get().source);
-				GetWorld().AddComponent(spawnedEntity, Expiration{});
+				GetWorld().Events<EnemyKilled>().Send({ spawnedEntity, entity });
+				GetWorld().DeferDestroyEntity(spawnedEntity);
 			}
 		}
 	}
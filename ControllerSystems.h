@@ -1,8 +1,11 @@
 #pragma once
 
+#include <unordered_set>
+
 #include "types.h"
 #include "ecs.h"
 #include "components.h"
+#include "PhysicsSystems.h"
 
 struct EnemyFollowTargetSystem : System<EnemyFollowTargetSystem, Transform, Velocity, EnemyTag>
 {
@@ -26,11 +29,36 @@ struct PlayerShootControlSystem : System<PlayerShootControlSystem, GameInput, Tr
 	void Update(const GameTime& time);
 };
 
+// Despawns bullets that hit a solid tile or an enemy and kills the enemies they hit.
+// Update runs in the physics stage once bullet velocities are set so each bullet's move for this tick is cast against the map before it happens.
+// ResolveHits runs after CollisionSystem in the same tick, so a bullet despawned this tick is still the entity its overlaps were found for.
+struct BulletSystem : System<BulletSystem, BulletTag, Transform, PhysicsBody>
+{
+	const PhysicsSystem* physicsSystem{};
+	const CollisionSystem* collisionSystem{};
+	void Update(const GameTime& time);
+	void ResolveHits();
+
+private:
+	void Despawn(Entity bullet);
+
+	std::unordered_set<Entity> spentBullets;
+	std::unordered_set<Entity> killedEnemies;
+	std::vector<Ray> rays;
+	std::vector<RaycastHit> hits;
+};
+
 
 struct SpawnerSystem : System<SpawnerSystem, Transform, Spawner>
 {
 	void OnRegistered() override;
 	void Update(const GameTime& time);
+	void UpdateKills(const GameTime& time);
+	void GatherInput();
 	Query<Reject<Prefab>, SpawnSource, Transform>* spawnSourceQuery{};
+
+private:
+	// Latched once per frame by GatherInput and consumed by the next fixed tick so a key press kills exactly once
+	bool killRequested{};
 };
 
@@ -3,23 +3,222 @@
 
 void EntityExpirationSystem::Update(const GameTime& time)
 {
-	std::queue<Entity> removeQueue{};
+	const std::vector<Entity>& entities = GetEntities();
+	for (QueryBase::Index index = 0; index < std::ssize(entities); ++index)
+	{
+		auto [expiration, pooled] = GetArchetypeAtIndex(index);
 
-	for (Entity entity : GetEntities())
+		expiration.secRemaining -= time.dt();
+
+		if (expiration.secRemaining <= 0)
+		{
+			// pooled entities go back to their pool instead of being destroyed, both are applied as a batch at the end of the stage
+			if (pooled)
+				GetWorld().DeferRelease(entities[index]);
+			else
+				GetWorld().DeferDestroyEntity(entities[index]);
+		}
+	}
+}
+
+void TransformHierarchySystem::OnEntityAdded(Entity entity)
+{
+	isHierarchyDirty = true;
+}
+
+void TransformHierarchySystem::OnEntityRemoved(Entity entity)
+{
+	isHierarchyDirty = true;
+}
+
+void TransformHierarchySystem::SetLocalTransform(Entity entity, const LocalTransform& local)
+{
+	GetWorld().GetComponent<LocalTransform>(entity) = local;
+	MarkDirty(entity);
+}
+
+void TransformHierarchySystem::MarkDirty(Entity entity)
+{
+	pendingDirtyEntities.emplace_back(entity);
+}
+
+void TransformHierarchySystem::SetParent(Entity entity, Entity parent)
+{
+	GetWorld().GetComponent<Parent>(entity).entity = parent;
+	isHierarchyDirty = true;
+}
+
+void TransformHierarchySystem::BuildHierarchy()
+{
+	World& world = GetWorld();
+	const std::vector<Entity>& entities = GetEntities();
+
+	std::unordered_map<Entity, std::vector<Entity>> children;
+	for (Entity entity : entities)
+		children[world.GetComponent<Parent>(entity).entity].emplace_back(entity);
+
+	nodeEntities.clear();
+	nodeParents.clear();
+	nodeIndices.clear();
+
+	// Parents that aren't children themselves are the roots, a parent that lost its Transform detaches its subtree
+	for (const auto& [parent, parentChildren] : children)
+	{
+		if (parent && !std::ranges::binary_search(entities, parent) && world.HasComponent<Transform>(parent))
+		{
+			nodeIndices[parent] = static_cast<int32_t>(nodeEntities.size());
+			nodeEntities.emplace_back(parent);
+			nodeParents.emplace_back(-1);
+		}
+	}
+	rootCount = static_cast<int32_t>(nodeEntities.size());
+
+	firstChildren.clear();
+	childCounts.clear();
+	for (int32_t node = 0; node < static_cast<int32_t>(nodeEntities.size()); ++node)
+	{
+		firstChildren.emplace_back(static_cast<int32_t>(nodeEntities.size()));
+		childCounts.emplace_back(0);
+
+		auto search = children.find(nodeEntities[node]);
+		if (search == children.end())
+			continue;
+
+		for (Entity child : search->second)
+		{
+			nodeIndices[child] = static_cast<int32_t>(nodeEntities.size());
+			nodeEntities.emplace_back(child);
+			nodeParents.emplace_back(node);
+		}
+		childCounts[node] = static_cast<int32_t>(search->second.size());
+	}
+
+#ifdef _DEBUG
+	// Subtrees below a parent that is gone or has no Transform are detached, any other child that isn't reached from a root is in a parent cycle
+	size_t detachedCount = 0;
+	std::vector<Entity> detached;
+	for (const auto& [parent, parentChildren] : children)
+	{
+		if (!nodeIndices.contains(parent) && !std::ranges::binary_search(entities, parent))
+			detached.insert(detached.end(), parentChildren.begin(), parentChildren.end());
+	}
+	while (!detached.empty())
 	{
-		auto& [secRemaining] = GetWorld().GetComponent<Expiration>(entity);
+		Entity entity = detached.back();
+		detached.pop_back();
+		++detachedCount;
 
-		secRemaining -= time.dt();
+		if (auto search = children.find(entity); search != children.end())
+			detached.insert(detached.end(), search->second.begin(), search->second.end());
+	}
+	ASSERT(nodeEntities.size() - rootCount + detachedCount == entities.size() && "Transform hierarchy contains a cycle.");
+#endif
+
+	worldTransforms.assign(nodeEntities.size(), Transform{});
+	queuedNodes.assign(nodeEntities.size(), false);
+	dirtyNodes.clear();
+
+	// The whole hierarchy is recomputed once after a rebuild
+	for (int32_t root = 0; root < rootCount; ++root)
+	{
+		auto transform = world.GetComponent<Transform>(nodeEntities[root]);
+		worldTransforms[root] = Transform{ transform.position, transform.scale, transform.rotation };
+		QueueChildren(root);
+	}
+
+	isHierarchyDirty = false;
+}
+
+void TransformHierarchySystem::QueueChildren(int32_t node)
+{
+	for (int32_t child = firstChildren[node]; child < firstChildren[node] + childCounts[node]; ++child)
+	{
+		if (!queuedNodes[child])
+		{
+			queuedNodes[child] = true;
+			dirtyNodes.emplace_back(child);
+			std::ranges::push_heap(dirtyNodes, std::greater<int32_t>());
+		}
+	}
+}
+
+void TransformHierarchySystem::Update(const GameTime& time)
+{
+	World& world = GetWorld();
 
-		if (secRemaining <= 0)
-			removeQueue.push(entity);
+	// Roots aren't in the query so their destruction or loss of Transform isn't reported through OnEntityRemoved
+	if (!isHierarchyDirty)
+	{
+		isHierarchyDirty = std::any_of(nodeEntities.begin(), nodeEntities.begin() + rootCount,
+			[&world](Entity root) { return !world.HasComponent<Transform>(root); });
 	}
 
-	while (!removeQueue.empty())
+	if (isHierarchyDirty)
+		BuildHierarchy();
+
+	for (int32_t root = 0; root < rootCount; ++root)
 	{
-		GetWorld().DestroyEntity(removeQueue.front());
-		removeQueue.pop();
+		auto current = world.GetComponent<Transform>(nodeEntities[root]);
+		Transform& cached = worldTransforms[root];
+		if (current.position != cached.position || current.scale != cached.scale || current.rotation != cached.rotation)  // NOLINT(clang-diagnostic-float-equal)
+		{
+			cached = Transform{ current.position, current.scale, current.rotation };
+			QueueChildren(root);
+		}
 	}
+
+	for (Entity entity : pendingDirtyEntities)
+	{
+		if (auto search = nodeIndices.find(entity); search != nodeIndices.end() && search->second >= rootCount && !queuedNodes[search->second])
+		{
+			queuedNodes[search->second] = true;
+			dirtyNodes.emplace_back(search->second);
+			std::ranges::push_heap(dirtyNodes, std::greater<int32_t>());
+		}
+	}
+	pendingDirtyEntities.clear();
+
+	while (!dirtyNodes.empty())
+	{
+		std::ranges::pop_heap(dirtyNodes, std::greater<int32_t>());
+		int32_t node = dirtyNodes.back();
+		dirtyNodes.pop_back();
+		queuedNodes[node] = false;
+
+		const Transform& parent = worldTransforms[nodeParents[node]];
+		const LocalTransform& local = world.GetComponent<LocalTransform>(nodeEntities[node]);
+
+		Transform& result = worldTransforms[node];
+		result.position = parent.position + vec2::Rotate(local.position * parent.scale, parent.rotation);
+		result.scale = parent.scale * local.scale;
+		result.rotation = parent.rotation + local.rotation;
+
+		auto transform = world.GetComponent<Transform>(nodeEntities[node]);
+		transform.position = result.position;
+		transform.scale = result.scale;
+		transform.rotation = result.rotation;
+
+		QueueChildren(node);
+	}
+}
+
+void TransformHistorySystem::Update()
+{
+	const std::vector<Entity>& entities = GetEntities();
+	for (QueryBase::Index index = 0; index < std::ssize(entities); ++index)
+	{
+		auto [transform, previous] = GetArchetypeAtIndex(index);
+		previous.position = transform.position;
+		previous.isCaptured = true;
+	}
+}
+
+Vec2 TransformHistorySystem::InterpolatePosition(Vec2 position, const PreviousTransform* previous, float alpha)
+{
+	if (!previous || !previous->isCaptured)
+		return position;
+
+	return vec2::Lerp(previous->position, position, alpha);
 }
 
 void ViewSystem::Update(const GameTime& time)
@@ -4,11 +4,56 @@
 #include "ecs.h"
 #include "types.h"
 
-struct EntityExpirationSystem : System<EntityExpirationSystem, Expiration>
+struct EntityExpirationSystem : System<EntityExpirationSystem, Expiration, Optional<Pooled>>
 {
 	void Update(const GameTime& time);
 };
 
+// Derives the world Transform of every entity with a Parent from its LocalTransform.
+// The hierarchy is flattened breadth-first into contiguous arrays, rebuilt only when entities join or leave it.
+// Each frame only subtrees below a root whose Transform changed, or below a node marked dirty, are recomputed.
+// Roots aren't part of the query so they are revalidated every frame, a root that was destroyed or lost its Transform triggers a rebuild
+// and its subtree is detached, keeping its last Transform until it is reparented.
+struct TransformHierarchySystem final : System<TransformHierarchySystem, Parent, LocalTransform, Transform>
+{
+	void OnEntityAdded(Entity entity) override;
+	void OnEntityRemoved(Entity entity) override;
+	void Update(const GameTime& time);
+
+	void SetLocalTransform(Entity entity, const LocalTransform& local);
+	void MarkDirty(Entity entity);
+	// Writing Parent directly isn't observed by the query, reparent through here or by removing and re-adding Parent
+	void SetParent(Entity entity, Entity parent);
+
+private:
+	void BuildHierarchy();
+	void QueueChildren(int32_t node);
+
+	// Nodes in breadth-first order, roots (parents without a Parent of their own) first, every node's children are contiguous
+	std::vector<Entity> nodeEntities;
+	std::vector<int32_t> nodeParents;
+	std::vector<int32_t> firstChildren;
+	std::vector<int32_t> childCounts;
+	std::vector<Transform> worldTransforms;
+	std::vector<bool> queuedNodes;
+	int32_t rootCount = 0;
+	std::unordered_map<Entity, int32_t> nodeIndices;
+
+	// Min heap of node indices, parents always have lower indices than their children so they are recomputed first
+	std::vector<int32_t> dirtyNodes;
+	std::vector<Entity> pendingDirtyEntities;
+	bool isHierarchyDirty = true;
+};
+
+// Captures Transform into PreviousTransform, must run first in every fixed simulation tick
+struct TransformHistorySystem final : System<TransformHistorySystem, Transform, PreviousTransform>
+{
+	void Update();
+
+	// Position between previous and current by alpha, or current when there is no captured previous
+	static Vec2 InterpolatePosition(Vec2 position, const PreviousTransform* previous, float alpha);
+};
+
 struct ViewSystem : System<ViewSystem, Transform, CameraView>
 {
 	Entity activeCameraEntity = kInvalidEntity;
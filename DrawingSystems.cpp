@@ -3,13 +3,26 @@
 #include "draw.h"
 #include "CoreSystems.h"
 
+void ColliderDebugDrawSystem::OnRegistered()
+{
+	boxQuery = GetWorld().CreateQuery<Reject<Prefab>, Transform, Collider::Box>();
+}
+
 void ColliderDebugDrawSystem::DrawMarkers(const DrawContext& ctx)
+{
+	DrawMarkers(ctx, *GetSystemQuery());
+	DrawMarkers(ctx, *boxQuery);
+}
+
+template <typename BoxQuery>
+void ColliderDebugDrawSystem::DrawMarkers(const DrawContext& ctx, BoxQuery& query)
 {
 	const auto& viewSystem = GetWorld().GetSystem<ViewSystem>();
 
-	for (Entity entity : GetEntities())
+	for (Entity entity : query.GetEntities())
 	{
-		auto [transform, box] = GetArchetype(entity);
+		auto [transform, collider] = query.GetArchetype(entity);
+		const Collider::Box& box = ComponentValue(collider);
 
 		Vec2 screenPos = viewSystem->WorldToScreen(transform.position + box.center);
 		Vec2 screenExtents = viewSystem->WorldScaleToScreen(box.extents);
@@ -60,14 +73,40 @@ void SpriteFacingSystem::Update()
 	}
 }
 
-void SpriteRenderSystem::Render(const DrawContext& ctx)
+void SpriteRenderSystem::OnRegistered()
+{
+	sharedSpriteQuery = GetWorld().CreateQuery<Reject<Prefab>, Transform, Shared<SpriteRender>, Optional<PreviousTransform>>();
+}
+
+void SpriteRenderSystem::Render(const DrawContext& ctx, float alpha)
 {
 	const auto& viewSystem = GetWorld().GetSystem<ViewSystem>();
 
+	// Entities sharing sprite data are drawn together, the shared value is only looked up once per group
+	sharedSpriteQuery->GroupByShared(sharedSpriteGroups);
+	for (const auto& [sprite, begin, end] : sharedSpriteGroups.groups)
+	{
+		for (int32_t i = begin; i < end; ++i)
+		{
+			QueryBase::Index index = sharedSpriteGroups.indices[i];
+			auto transform = sharedSpriteQuery->GetComponentAtIndex<Transform>(index);
+			const PreviousTransform* previous = sharedSpriteQuery->GetOptionalComponentAtIndex<PreviousTransform>(index);
+			Vec2 screenPos = viewSystem->WorldToScreen(TransformHistorySystem::InterpolatePosition(transform.position, previous, alpha));
+			draw::Sprite(ctx,
+				ctx.sheet,
+				sprite->spriteId,
+				screenPos,
+				transform.rotation,
+				sprite->flipFlags,
+				sprite->origin,
+				transform.scale);
+		}
+	}
+
 	for (Entity entity : GetEntities())
 	{
-		auto [transform, sprite] = GetArchetype(entity);
-		Vec2 screenPos = viewSystem->WorldToScreen(transform.position);
+		auto [transform, sprite, previous] = GetArchetype(entity);
+		Vec2 screenPos = viewSystem->WorldToScreen(TransformHistorySystem::InterpolatePosition(transform.position, previous, alpha));
 		draw::Sprite(ctx,
 			ctx.sheet,
 			sprite.spriteId,
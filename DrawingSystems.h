@@ -4,9 +4,16 @@
 #include "ecs.h"
 #include "types.h"
 
-struct ColliderDebugDrawSystem : System<ColliderDebugDrawSystem, Transform, Collider::Box>
+struct ColliderDebugDrawSystem : System<ColliderDebugDrawSystem, Transform, Shared<Collider::Box>>
 {
+	void OnRegistered() override;
 	void DrawMarkers(const DrawContext& ctx);
+
+private:
+	template <typename BoxQuery>
+	void DrawMarkers(const DrawContext& ctx, BoxQuery& query);
+
+	Query<Reject<Prefab>, Transform, Collider::Box>* boxQuery{};
 };
 
 struct GameMapRenderSystem : System<GameMapRenderSystem, Transform, GameMapRender>
@@ -25,7 +32,13 @@ struct SpriteFacingSystem : System<SpriteFacingSystem, Facing, FacingSprites, Sp
 	void Update();
 };
 
-struct SpriteRenderSystem : System<SpriteRenderSystem, Transform, SpriteRender>
+// Sprites of entities with a PreviousTransform are drawn interpolated between the last two simulation ticks by alpha, see GameTime::alpha
+struct SpriteRenderSystem : System<SpriteRenderSystem, Transform, SpriteRender, Optional<PreviousTransform>>
 {
-	void Render(const DrawContext& ctx);
+	void OnRegistered() override;
+	void Render(const DrawContext& ctx, float alpha);
+
+private:
+	Query<Reject<Prefab>, Transform, Shared<SpriteRender>, Optional<PreviousTransform>>* sharedSpriteQuery{};
+	SharedGroups<SpriteRender> sharedSpriteGroups;
 };
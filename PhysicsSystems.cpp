@@ -5,6 +5,29 @@
 
 #include "components.h"
 #include "debug.h"
+#include "jobs.h"
+#include "simd.h"
+
+// Physics touches every body each frame so it owns the storage order of Transform and PhysicsBody
+void PhysicsSystem::OnRegistered()
+{
+	GetWorld().OwnStorage(GetSystemQuery());
+	tileColliderQuery = GetWorld().CreateQuery<Reject<Prefab>, Transform, PhysicsBody, Collider::Box, Optional<DebugMarker>>();
+	sharedTileColliderQuery = GetWorld().CreateQuery<Reject<Prefab>, Transform, PhysicsBody, Shared<Collider::Box>, Optional<DebugMarker>>();
+}
+
+void PhysicsSystem::OnEntityAdded(Entity entity)
+{
+	awakeFlags.set(entity);
+	wokenEntities.emplace_back(entity);
+	isAwakeListStale = true;
+}
+
+void PhysicsSystem::OnEntityRemoved(Entity entity)
+{
+	awakeFlags.reset(entity);
+	isAwakeListStale = true;
+}
 
 void PhysicsSystem::SetMap(GameMapHandle handle)
 {
@@ -18,63 +41,327 @@ void PhysicsSystem::SetMap(GameMapHandle handle)
 
 void PhysicsSystem::Update(const GameTime& time)
 {
-	for (Entity entity : GetEntities())
+	const float sleepDistance = kSleepSpeed * time.dt();
+
+	GatherAwakeBodies();
+	ResolveTiles(*tileColliderQuery);
+	ResolveTiles(*sharedTileColliderQuery);
+	Integrate();
+	CountStillTicks(sleepDistance);
+}
+
+void PhysicsSystem::Wake(Entity entity)
+{
+	if (awakeFlags.test(entity) || !GetWorld().HasComponent<PhysicsBody>(entity))
+		return;
+
+	GetWorld().GetComponent<PhysicsBody>(entity).stillTicks = 0;
+	awakeFlags.set(entity);
+	wokenEntities.emplace_back(entity);
+}
+
+void PhysicsSystem::WakeContacts(std::span<const Contact> contacts)
+{
+	for (const Contact& contact : contacts)
+	{
+		if (awakeFlags.test(contact.a) != awakeFlags.test(contact.b))
+		{
+			Wake(contact.a);
+			Wake(contact.b);
+		}
+	}
+}
+
+// Query indices only shift when entities join or leave the query, otherwise the awake list kept from the last update is reused
+// and only bodies woken since are looked up and merged in. Indices stay sorted so the passes below walk the storage in order.
+// Awake bodies remember the velocity requested before tile collision clips it, a body added back to the query asleep is woken.
+void PhysicsSystem::GatherAwakeBodies()
+{
+	const std::vector<Entity>& entities = GetEntities();
+	auto findIndex = [this, &entities](Entity entity) -> std::optional<QueryBase::Index>
 	{
-		auto [transform, body] = GetArchetype(entity);
+		QueryBase::Index index = GetSystemQuery()->FindEntityIndex(entity);
+		if (index < std::ssize(entities) && entities[index] == entity)
+			return index;
+		return std::nullopt;
+	};
 
-		Vec2 origin = transform.position;
+	if (isAwakeListStale)
+	{
+		awakeIndices.clear();
+		for (Entity entity : awakeEntities)
+		{
+			if (auto index = findIndex(entity))
+				awakeIndices.emplace_back(*index);
+		}
+		isAwakeListStale = false;
+	}
 
-		auto calculateSolid = [this](const Transform& t, Vec2 velocity, const Collider::Box& collider) -> std::pair<bool, Vec2>
+	if (!wokenEntities.empty())
+	{
+		for (Entity entity : wokenEntities)
 		{
-			Bounds2D colliderBounds = Bounds2D::FromCenter(t.position + collider.center, collider.extents);
+			if (auto index = findIndex(entity))
+				awakeIndices.emplace_back(*index);
+			else
+				awakeFlags.reset(entity);
+		}
+		wokenEntities.clear();
 
-			auto [velX, velY] = vec2::UnitVectors(velocity);
-			bool foundSolid = false;
+		std::ranges::sort(awakeIndices);
+		awakeIndices.erase(std::ranges::unique(awakeIndices).begin(), awakeIndices.end());
+	}
 
-			while (!vec2::ApproxZero(velX) && MapSolid(colliderBounds, velX))
-			{
-				velX.x = math::MoveTo(velX.x, 0.0f, 0.0625f);
-				foundSolid = true;
-			}
+	awakeEntities.clear();
+	for (QueryBase::Index index : awakeIndices)
+	{
+		awakeEntities.emplace_back(entities[index]);
 
-			while (!vec2::ApproxZero(velY) && MapSolid(colliderBounds, velY))
-			{
-				velY.y = math::MoveTo(velY.y, 0.0f, 0.0625f);
-				foundSolid = true;
-			}
+		auto [transform, body] = GetArchetypeAtIndex(index);
+		if (IsAsleep(body.stillTicks))
+			body.stillTicks = 0;
+		body.restVelocity = body.velocity;
+	}
+	awakeCount = static_cast<int>(awakeIndices.size());
+}
 
-			velocity.x = velX.x;
-			velocity.y = velY.y;
-			while (!vec2::ApproxZero(velocity) && MapSolid(colliderBounds, velocity))
-			{
-				velocity = vec2::MoveTo(velocity, vec2::Zero, 0.0625f);
-				foundSolid = true;
-			}
+// Bodies only read the map and write their own velocity so they are resolved in parallel batches,
+// adding missing debug markers changes storage and is left for a serial pass in entity order
+template <typename TileColliderQuery>
+void PhysicsSystem::ResolveTiles(TileColliderQuery& query)
+{
+	constexpr int kBodiesPerBatch = 128;
 
-			return {foundSolid, velocity};
-		};
-		
-		if (auto collider = GetWorld().GetOptionalComponent<Collider::Box>(entity); collider.has_value())
+	const std::vector<Entity>& entities = query.GetEntities();
+	missingMarkerColors.assign(entities.size(), std::nullopt);
+
+	jobs::ParallelFor(static_cast<int>(entities.size()), kBodiesPerBatch, [this, &query](int begin, int end)
+	{
+		for (QueryBase::Index index = begin; index < end; ++index)
 		{
-			if (auto [foundSolid, newVelocity] = calculateSolid(transform, body.velocity, collider.value()); foundSolid)
-			{
+			auto [transform, body, collider, marker] = query.GetArchetypeAtIndex(index);
+			if (IsAsleep(body.stillTicks))
+				continue;
+
+			const Collider::Box& box = ComponentValue(collider);
+			auto [foundSolid, newVelocity] = SweepTiles(Bounds2D::FromCenter(transform.position + box.center, box.extents), body.velocity);
+			if (foundSolid)
 				body.velocity = newVelocity;
 
-				auto& [color] = GetWorld().GetOrAddComponent(entity, DebugMarker{});
-				color = color::RGB(255, 0, 255);
-			}
+			Color markerColor = foundSolid ? color::RGB(255, 0, 255) : color::RGB(0, 255, 255);
+			if (marker)
+				marker->color = markerColor;
 			else
-			{
-				auto& marker = GetWorld().GetOrAddComponent(entity, DebugMarker{});
-				marker.color = color::RGB(0, 255, 255);
-			}
+				missingMarkerColors[index] = markerColor;
 		}
+	});
+
+	for (QueryBase::Index index = 0; index < std::ssize(entities); ++index)
+	{
+		if (missingMarkerColors[index])
+			GetWorld().AddComponent(entities[index], DebugMarker{ *missingMarkerColors[index] });
+	}
+}
+
+// Once the reorder pass has co-sorted Transform and PhysicsBody and most bodies are awake, streaming the whole owned spans through the SIMD kernel
+// is cheaper than visiting the awake bodies one at a time. Sleepers have no velocity so they don't move either way.
+void PhysicsSystem::Integrate()
+{
+	if (GetSystemQuery()->IsStorageOrdered() && std::ssize(awakeIndices) * 2 >= std::ssize(GetEntities()))
+	{
+		simd::AddVec2(GetSystemQuery()->GetOwnedFieldSpan<&Transform::position>(), GetSystemQuery()->GetOwnedFieldSpan<&PhysicsBody::velocity>());
+		return;
+	}
 
+	for (QueryBase::Index index : awakeIndices)
+	{
+		auto [transform, body] = GetArchetypeAtIndex(index);
 		transform.position = transform.position + body.velocity;
+	}
+}
+
+// Uses the velocity left after tile collision so a body pushing against a wall counts as still, bodies falling asleep leave the awake list
+void PhysicsSystem::CountStillTicks(float sleepDistance)
+{
+	size_t awake = 0;
+	for (size_t i = 0; i < awakeIndices.size(); ++i)
+	{
+		auto [transform, body] = GetArchetypeAtIndex(awakeIndices[i]);
+		if (vec2::LengthSqr(body.velocity) <= sleepDistance * sleepDistance)
+			++body.stillTicks;
+		else
+			body.stillTicks = 0;
+
+		if (IsAsleep(body.stillTicks))
+		{
+			body.velocity = vec2::Zero;
+			awakeFlags.reset(awakeEntities[i]);
+			continue;
+		}
+
+		awakeIndices[awake] = awakeIndices[i];
+		awakeEntities[awake] = awakeEntities[i];
+		++awake;
+	}
+	awakeIndices.resize(awake);
+	awakeEntities.resize(awake);
+}
+
+// Moves the box one axis at a time, x first so a blocked diagonal slides along the wall instead of stopping
+std::pair<bool, Vec2> PhysicsSystem::SweepTiles(Bounds2D bounds, Vec2 velocity) const
+{
+	bool blocked = false;
+
+	float leadX = velocity.x > 0.0f ? bounds.max.x : bounds.min.x;
+	velocity.x = SweepAxis(leadX, velocity.x, bounds.min.y, bounds.max.y, true, blocked);
+	bounds.min.x += velocity.x;
+	bounds.max.x += velocity.x;
+
+	float leadY = velocity.y > 0.0f ? bounds.max.y : bounds.min.y;
+	velocity.y = SweepAxis(leadY, velocity.y, bounds.min.x, bounds.max.x, false, blocked);
+
+	return { blocked, velocity };
+}
+
+// Walks the tile columns (or rows) the leading edge crosses and stops at the first one with a solid tile in the span covered by the box.
+// The returned move leaves the edge kTileSkin short of the tile so the next sweep starts outside of it, tiles the edge already overlaps are ignored.
+float PhysicsSystem::SweepAxis(float leadEdge, float move, float spanMin, float spanMax, bool horizontal, bool& blocked) const
+{
+	constexpr float kTileSkin = 1.0f / 1024.0f;
+
+	if (move == 0.0f || !activeMap || !activeSolidLayer)
+		return move;
+
+	const int spanFirst = math::FloorToInt(spanMin);
+	const int spanLast = math::FloorToInt(spanMax);
+	const int step = move > 0.0f ? 1 : -1;
+	const int lineLast = math::FloorToInt(leadEdge + move);
+	// A max edge lying exactly on a tile boundary doesn't overlap the tile starting there yet, a min edge on a boundary does overlap it
+	const int lineFirst = step > 0 ? math::CeilToInt(leadEdge) : math::FloorToInt(leadEdge) - 1;
+
+	for (int line = lineFirst; line * step <= lineLast * step; line += step)
+	{
+		bool solid = horizontal
+			? map::AnySolid(*activeSolidLayer, line, spanFirst, line, spanLast)
+			: map::AnySolid(*activeSolidLayer, spanFirst, line, spanLast, line);
+		if (!solid)
+			continue;
+
+		blocked = true;
+		return step > 0
+			? std::max(static_cast<float>(line) - kTileSkin - leadEdge, 0.0f)
+			: std::min(static_cast<float>(line + 1) + kTileSkin - leadEdge, 0.0f);
+	}
+
+	return move;
+}
+
+// Amanatides & Woo grid traversal: the ray is first clipped to the layer, then steps into whichever neighboring tile it reaches first,
+// tMax is the distance along the ray to the next tile boundary on each axis and tDelta the distance between boundaries
+RaycastHit PhysicsSystem::Raycast(const Ray& ray) const
+{
+	RaycastHit result{};
+	float length = vec2::Length(ray.direction);
+	if (!activeSolidLayer || length == 0.0f || ray.maxDistance < 0.0f)
+		return result;
+
+	const GameMapTileLayer& layer = *activeSolidLayer;
+	const Vec2 dir = ray.direction / length;
+	const float origin[2] = { ray.origin.x, ray.origin.y };
+	const float direction[2] = { dir.x, dir.y };
+	const int tileCount[2] = { layer.tileCountX, layer.tileCountY };
+
+	float tEnter = 0.0f;
+	float tExit = ray.maxDistance;
+	int enterAxis = -1;
+	for (int axis = 0; axis < 2; ++axis)
+	{
+		if (direction[axis] == 0.0f)
+		{
+			if (origin[axis] < 0.0f || origin[axis] >= static_cast<float>(tileCount[axis]))
+				return result;
+			continue;
+		}
+
+		float t0 = (0.0f - origin[axis]) / direction[axis];
+		float t1 = (static_cast<float>(tileCount[axis]) - origin[axis]) / direction[axis];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		if (t0 > tEnter)
+		{
+			tEnter = t0;
+			enterAxis = axis;
+		}
+		tExit = std::min(tExit, t1);
+	}
+
+	if (tEnter > tExit)
+		return result;
+
+	int tile[2];
+	int step[2];
+	float tMax[2];
+	float tDelta[2];
+	for (int axis = 0; axis < 2; ++axis)
+	{
+		float entry = origin[axis] + direction[axis] * tEnter;
+		tile[axis] = std::clamp(math::FloorToInt(entry), 0, tileCount[axis] - 1);
+		step[axis] = direction[axis] > 0.0f ? 1 : -1;
+
+		if (direction[axis] == 0.0f)
+		{
+			tMax[axis] = std::numeric_limits<float>::max();
+			tDelta[axis] = std::numeric_limits<float>::max();
+			continue;
+		}
+
+		float boundary = static_cast<float>(direction[axis] > 0.0f ? tile[axis] + 1 : tile[axis]);
+		tMax[axis] = (boundary - origin[axis]) / direction[axis];
+		tDelta[axis] = std::abs(1.0f / direction[axis]);
+	}
+
+	float t = tEnter;
+	int hitAxis = enterAxis;
+	while (true)
+	{
+		if (map::TileSolid(layer, tile[0], tile[1]))
+		{
+			result.hit = true;
+			result.tileX = tile[0];
+			result.tileY = tile[1];
+			result.distance = t;
+			result.point = ray.origin + dir * t;
+			if (hitAxis == 0)
+				result.normal = { static_cast<float>(-step[0]), 0.0f };
+			else if (hitAxis == 1)
+				result.normal = { 0.0f, static_cast<float>(-step[1]) };
+			return result;
+		}
+
+		hitAxis = tMax[0] < tMax[1] ? 0 : 1;
+		t = tMax[hitAxis];
+		if (t > tExit)
+			return result;
 
+		tile[hitAxis] += step[hitAxis];
+		tMax[hitAxis] += tDelta[hitAxis];
+		if (tile[hitAxis] < 0 || tile[hitAxis] >= tileCount[hitAxis])
+			return result;
 	}
 }
 
+void PhysicsSystem::Raycast(std::span<const Ray> rays, std::span<RaycastHit> hits) const
+{
+	constexpr int kRaysPerBatch = 256;
+
+	ASSERT(rays.size() == hits.size() && "Raycast needs one hit per ray.");
+	jobs::ParallelFor(static_cast<int>(rays.size()), kRaysPerBatch, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+			hits[i] = Raycast(rays[i]);
+	});
+}
+
 bool PhysicsSystem::MapSolid(const Vec2& point) const
 {
 	if (!activeMap || !activeSolidLayer)
@@ -83,76 +370,361 @@ bool PhysicsSystem::MapSolid(const Vec2& point) const
 	if (!activeMap->worldBounds.ContainsPoint(point))
 		return false;
 
-	GameMapTileLayer& solidLayer = *activeSolidLayer;
-
-	auto [pointX, pointY] = point;
-	int px = math::FloorToInt(pointX);
-	int py = math::FloorToInt(pointY);
-	int index = px + py * solidLayer.tileCountX;
-	auto [tileGlobalId, position, flipFlags] = solidLayer.tiles[index];
+	return map::TileSolid(*activeSolidLayer, math::FloorToInt(point.x), math::FloorToInt(point.y));
+}
 
-	if (tileGlobalId == 0)
+bool PhysicsSystem::MapSolid(const Bounds2D& bounds, const Vec2& velocity) const
+{
+	if (!activeMap || !activeSolidLayer)
 		return false;
 
-	int id = tileGlobalId - 1;
+	Vec2 min = bounds.min + velocity;
+	Vec2 max = bounds.max + velocity;
+	return map::AnySolid(*activeSolidLayer, math::FloorToInt(min.x), math::FloorToInt(min.y), math::FloorToInt(max.x), math::FloorToInt(max.y));
+}
+
+// A sleeping body stays put until it is asked to move differently from when it fell asleep
+void PhysicsBodyVelocitySystem::Update(const GameTime& time)
+{
+	const float sleepDistance = PhysicsSystem::kSleepSpeed * time.dt();
+
+	for (QueryBase::Index index = 0; index < std::ssize(GetEntities()); ++index)
+	{
+		auto [velocity, body] = GetArchetypeAtIndex(index);
+		Vec2 requested = velocity.velocity * time.dt();
+
+		if (physicsSystem && PhysicsSystem::IsAsleep(body.stillTicks))
+		{
+			if (vec2::LengthSqr(requested - body.restVelocity) <= sleepDistance * sleepDistance)
+			{
+				body.velocity = vec2::Zero;
+				continue;
+			}
+			physicsSystem->Wake(GetEntities()[index]);
+		}
 
-	return (id == 7 || id == 58);
+		body.velocity = requested;
+	}
 }
 
-bool PhysicsSystem::MapSolid(const Bounds2D& bounds, const Vec2& velocity) const
+// Nudge radii are small compared to the spread of entities so neighbors are found with a spatial hash instead of comparing every pair.
+// Each body gathers the push of its own neighbors instead of pairs scattering into both bodies, so a body is only ever written by the chunk that owns it.
+// Chunks are fixed size runs of bodies in the index's cell order, neighbors in other chunks are only read. A body always sums its neighbors
+// in the same order wherever the chunk boundaries fall, so the result doesn't depend on the number of threads.
+// Sleepers are in the index too so they push awake bodies, they aren't pushed themselves. A sleeper in range of an awake body is recorded
+// by the chunk that found it and woken in a serial pass afterwards, so it rejoins the awake list in the same order every run.
+void PhysicsNudgeSystem::OnRegistered()
 {
-	return std::ranges::any_of(bounds.Corners(),
-		[this, velocity](auto&& p) { return MapSolid(p + velocity); });
+	nudgeQuery = GetWorld().CreateQuery<Reject<Prefab>, Transform, PhysicsNudge, PhysicsBody>();
 }
 
-void PhysicsBodyVelocitySystem::Update(const GameTime& time)
+template <typename NudgeQuery>
+void PhysicsNudgeSystem::InsertBodies(NudgeQuery& query, bool isShared)
 {
-	for (Entity entity : GetEntities())
+	const std::vector<Entity>& entities = query.GetEntities();
+	for (QueryBase::Index index = 0; index < std::ssize(entities); ++index)
 	{
-		auto [velocity, body] = GetArchetype(entity);
-		body.velocity = velocity.velocity * time.dt();
+		auto [transform, nudge, body] = query.GetArchetypeAtIndex(index);
+		nudgeBodies.emplace_back(NudgeBody{ ComponentValue(nudge), entities[index], index, isShared, PhysicsSystem::IsAsleep(body.stillTicks) });
+		spatialIndex.Insert(transform.position, ComponentValue(nudge).radius);
 	}
 }
 
 void PhysicsNudgeSystem::Update(const GameTime& time)
 {
-	const std::vector<Entity>& entityVector = GetEntities();
+	constexpr int kBodiesPerChunk = 256;
+
+	nudgeBodies.clear();
+	spatialIndex.Clear();
+	InsertBodies(*GetSystemQuery(), true);
+	InsertBodies(*nudgeQuery, false);
+	spatialIndex.Build();
+
+	const int chunkCount = (spatialIndex.Count() + kBodiesPerChunk - 1) / kBodiesPerChunk;
+	if (std::ssize(chunkSleepers) < chunkCount)
+		chunkSleepers.resize(chunkCount);
+
+	const float dt = time.dt();
+	jobs::ParallelFor(chunkCount, 1, [this, dt](int begin, int end)
+	{
+		for (int chunk = begin; chunk < end; ++chunk)
+		{
+			std::vector<Entity>& sleepers = chunkSleepers[chunk];
+			sleepers.clear();
+
+			const int last = std::min((chunk + 1) * kBodiesPerChunk, spatialIndex.Count());
+			for (int sorted = chunk * kBodiesPerChunk; sorted < last; ++sorted)
+			{
+				const int i = spatialIndex.GetSortedItem(sorted);
+				const NudgeBody& self = nudgeBodies[i];
+				if (self.isAsleep)
+					continue;
+
+				const PhysicsNudge& nudge = self.nudge;
+
+				Vec2 nudgeVelocity = vec2::Zero;
+				spatialIndex.ForEachOverlapOfSorted(sorted, [&](int j, Vec2 delta, float distSqr)
+				{
+					const NudgeBody& neighbor = nudgeBodies[j];
+					const PhysicsNudge& other = neighbor.nudge;
+					if (neighbor.isAsleep)
+						sleepers.emplace_back(neighbor.entity);
+
+					float dist = std::sqrt(distSqr);
+					float totalRadius = nudge.radius + other.radius;
+
+					// Bodies on the same spot are pushed apart along x, the lower index one towards -x
+					Vec2 dir = (dist > 0) ? delta / dist : (i < j ? vec2::UnitX : vec2::UnitX * -1.0f);
+
+					float ratio = dist / totalRadius;
+					float strength = (other.maxStrength > other.minStrength) ? math::lerp(other.maxStrength, other.minStrength, ratio) : other.minStrength;
+					nudgeVelocity = nudgeVelocity - dir * strength;
+				});
+
+				auto body = self.isShared
+					? GetSystemQuery()->GetComponentAtIndex<PhysicsBody>(self.index)
+					: nudgeQuery->GetComponentAtIndex<PhysicsBody>(self.index);
+				body.velocity = body.velocity + nudgeVelocity * dt;
+			}
+		}
+	});
+
+	if (!physicsSystem)
+		return;
+
+	for (int chunk = 0; chunk < chunkCount; ++chunk)
+	{
+		for (Entity sleeper : chunkSleepers[chunk])
+			physicsSystem->Wake(sleeper);
+	}
+}
+
+void CollisionSystem::OnRegistered()
+{
+	boxQuery = GetWorld().CreateQuery<Reject<Prefab>, Transform, Collider::Box, Optional<PhysicsLayer>, Optional<Trigger>>();
+	circleQuery = GetWorld().CreateQuery<Reject<Prefab>, Transform, Collider::Circle, Optional<PhysicsLayer>, Optional<Trigger>>();
+}
+
+void CollisionSystem::AddProxy(Entity entity, Vec2 position, const Collider::Box& box, const PhysicsLayer* layer, const Trigger* trigger)
+{
+	Vec2 center = position + box.center;
+	Proxy& proxy = proxies.emplace_back(Proxy{ Bounds2D::FromCenter(center, box.extents), center, box.extents, 0.0f, entity, ShapeType::Box });
+	proxy.layer = layer ? layer->layer : PhysicsLayerFlags::Default;
+	proxy.collidesWith = layer ? layer->collidesWith : PhysicsLayerFlags::All;
+	proxy.isTrigger = trigger != nullptr;
+}
+
+void CollisionSystem::AddProxy(Entity entity, Vec2 position, const Collider::Circle& circle, const PhysicsLayer* layer, const Trigger* trigger)
+{
+	Vec2 center = position + circle.center;
+	Vec2 extents{ circle.radius, circle.radius };
+	Proxy& proxy = proxies.emplace_back(Proxy{ Bounds2D::FromCenter(center, extents), center, extents, circle.radius, entity, ShapeType::Circle });
+	proxy.layer = layer ? layer->layer : PhysicsLayerFlags::Default;
+	proxy.collidesWith = layer ? layer->collidesWith : PhysicsLayerFlags::All;
+	proxy.isTrigger = trigger != nullptr;
+}
+
+void CollisionSystem::Update()
+{
+	proxies.clear();
+	contacts.clear();
+	triggerPairs.clear();
 
-	for (Entity entity : entityVector)
+	const std::vector<Entity>& entities = GetEntities();
+	for (QueryBase::Index index = 0; index < std::ssize(entities); ++index)
 	{
-		GetWorld().GetComponent<PhysicsNudge>(entity).velocity = vec2::Zero;
+		auto [transform, box, layer, trigger] = GetArchetypeAtIndex(index);
+		AddProxy(entities[index], transform.position, *box, layer, trigger);
 	}
 
-	for (int i = 0; i < static_cast<int>(entityVector.size()) - 1; ++i)
+	for (QueryBase::Index index = 0; index < std::ssize(boxQuery->GetEntities()); ++index)
 	{
-		Entity entity0 = entityVector[i];
-		auto [transform0, nudge0, body0] = GetArchetype(entity0);
+		auto [transform, box, layer, trigger] = boxQuery->GetArchetypeAtIndex(index);
+		AddProxy(boxQuery->GetEntities()[index], transform.position, box, layer, trigger);
+	}
+
+	for (QueryBase::Index index = 0; index < std::ssize(circleQuery->GetEntities()); ++index)
+	{
+		auto [transform, circle, layer, trigger] = circleQuery->GetArchetypeAtIndex(index);
+		AddProxy(circleQuery->GetEntities()[index], transform.position, circle, layer, trigger);
+	}
 
-		for (int j = i + 1; j < static_cast<int>(entityVector.size()); ++j)
+	// A stable sort keeps proxies with equal left edges in query order so the contact order is reproducible
+	std::ranges::stable_sort(proxies, {}, [](const Proxy& proxy) { return proxy.bounds.min.x; });
+
+	// The chunk size doesn't depend on the thread count, neither do the chunk boundaries or the merged results
+	constexpr size_t kProxiesPerChunk = 256;
+	const size_t chunkCount = (proxies.size() + kProxiesPerChunk - 1) / kProxiesPerChunk;
+	if (sweepChunks.size() < chunkCount)
+		sweepChunks.resize(chunkCount);
+
+	jobs::ParallelFor(static_cast<int>(chunkCount), 1, [this](int begin, int end)
+	{
+		for (int chunk = begin; chunk < end; ++chunk)
+			Sweep(chunk * kProxiesPerChunk, std::min((chunk + 1) * kProxiesPerChunk, proxies.size()), sweepChunks[chunk]);
+	});
+
+	for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+	{
+		contacts.insert(contacts.end(), sweepChunks[chunk].contacts.begin(), sweepChunks[chunk].contacts.end());
+		triggerPairs.insert(triggerPairs.end(), sweepChunks[chunk].triggerPairs.begin(), sweepChunks[chunk].triggerPairs.end());
+	}
+
+	SendTriggerEvents();
+
+	if (physicsSystem)
+		physicsSystem->WakeContacts(contacts);
+}
+
+// Proxies are sorted on their left edge so the sweep can stop at the first proxy starting right of the current one.
+// Proxies in [first, last) are tested against every later proxy, including those of later chunks which are only read.
+void CollisionSystem::Sweep(size_t first, size_t last, SweepChunk& chunk) const
+{
+	chunk.contacts.clear();
+	chunk.triggerPairs.clear();
+
+	for (size_t i = first; i < last; ++i)
+	{
+		const Proxy& a = proxies[i];
+		for (size_t j = i + 1; j < proxies.size() && proxies[j].bounds.min.x <= a.bounds.max.x; ++j)
 		{
-			Entity entity1 = entityVector[j];
-			auto [transform1, nudge1, body1] = GetArchetype(entity1);
+			const Proxy& b = proxies[j];
+			if (b.bounds.min.y > a.bounds.max.y || b.bounds.max.y < a.bounds.min.y || a.entity == b.entity)
+				continue;
 
-			Vec2 delta = transform1.position - transform0.position;
-			float dist = vec2::Length(delta);
-			float totalRadius = nudge0.radius + nudge1.radius;
-			if (dist <= nudge0.radius + nudge1.radius)
-			{
-				Vec2 dir = (dist > 0) ? delta / dist : vec2::UnitX;
+			if (!(a.layer & b.collidesWith) || !(b.layer & a.collidesWith))
+				continue;
 
-				float ratio = dist / totalRadius;
-				float strength0 = (nudge0.maxStrength > nudge0.minStrength) ? math::lerp(nudge0.maxStrength, nudge0.minStrength, ratio) : nudge0.minStrength;
-				float strength1 = (nudge1.maxStrength > nudge1.minStrength) ? math::lerp(nudge1.maxStrength, nudge1.minStrength, ratio) : nudge1.minStrength;
+			Contact contact;
+			if (!Collide(a, b, contact))
+				continue;
 
-				nudge0.velocity = nudge0.velocity - dir * strength1;
-				nudge1.velocity = nudge1.velocity + dir * strength0;
+			if (!a.isTrigger && !b.isTrigger)
+			{
+				chunk.contacts.emplace_back(contact);
+				continue;
 			}
+
+			if (a.isTrigger)
+				chunk.triggerPairs.emplace_back(TriggerPair{ a.entity, b.entity });
+			if (b.isTrigger)
+				chunk.triggerPairs.emplace_back(TriggerPair{ b.entity, a.entity });
 		}
 	}
+}
 
-	for (Entity entity : entityVector)
+// Both pair sets are sorted so a single merge finds the pairs that are only in one of them.
+// Entities with more than one collider can overlap the same trigger through several of them, duplicates are removed first.
+void CollisionSystem::SendTriggerEvents()
+{
+	std::ranges::sort(triggerPairs);
+	auto [first, last] = std::ranges::unique(triggerPairs);
+	triggerPairs.erase(first, last);
+
+	EventChannel<TriggerBegin>& beginEvents = GetWorld().Events<TriggerBegin>();
+	EventChannel<TriggerEnd>& endEvents = GetWorld().Events<TriggerEnd>();
+
+	triggerBegins.clear();
+	auto current = triggerPairs.begin();
+	auto previous = previousTriggerPairs.begin();
+	while (current != triggerPairs.end() || previous != previousTriggerPairs.end())
+	{
+		if (previous == previousTriggerPairs.end() || (current != triggerPairs.end() && *current < *previous))
+		{
+			triggerBegins.emplace_back(TriggerBegin{ current->trigger, current->other });
+			beginEvents.Send(triggerBegins.back());
+			++current;
+		}
+		else if (current == triggerPairs.end() || *previous < *current)
+		{
+			endEvents.Send({ previous->trigger, previous->other });
+			++previous;
+		}
+		else
+		{
+			++current;
+			++previous;
+		}
+	}
+
+	std::swap(triggerPairs, previousTriggerPairs);
+}
+
+// Box proxies are axis aligned, a circle inside a box is pushed out along the axis it is closest to leaving by
+bool CollisionSystem::Collide(const Proxy& a, const Proxy& b, Contact& contact)
+{
+	if (a.shape == ShapeType::Circle && b.shape == ShapeType::Box)
+	{
+		if (!Collide(b, a, contact))
+			return false;
+		std::swap(contact.a, contact.b);
+		contact.normal = contact.normal * -1.0f;
+		return true;
+	}
+
+	contact.a = a.entity;
+	contact.b = b.entity;
+	Vec2 delta = b.center - a.center;
+
+	if (a.shape == ShapeType::Box && b.shape == ShapeType::Box)
+	{
+		float overlapX = a.extents.x + b.extents.x - std::abs(delta.x);
+		float overlapY = a.extents.y + b.extents.y - std::abs(delta.y);
+		if (overlapX <= 0.0f || overlapY <= 0.0f)
+			return false;
+
+		if (overlapX < overlapY)
+		{
+			contact.normal = { delta.x < 0.0f ? -1.0f : 1.0f, 0.0f };
+			contact.depth = overlapX;
+		}
+		else
+		{
+			contact.normal = { 0.0f, delta.y < 0.0f ? -1.0f : 1.0f };
+			contact.depth = overlapY;
+		}
+		return true;
+	}
+
+	if (a.shape == ShapeType::Circle)
+	{
+		float totalRadius = a.radius + b.radius;
+		float distSqr = vec2::LengthSqr(delta);
+		if (distSqr >= totalRadius * totalRadius)
+			return false;
+
+		float dist = std::sqrt(distSqr);
+		contact.normal = dist > 0.0f ? delta / dist : vec2::UnitX;
+		contact.depth = totalRadius - dist;
+		return true;
+	}
+
+	// Box a against circle b
+	Vec2 closest = a.bounds.ClampPoint(b.center);
+	Vec2 outside = b.center - closest;
+	float distSqr = vec2::LengthSqr(outside);
+	if (distSqr >= b.radius * b.radius)
+		return false;
+
+	if (distSqr > 0.0f)
+	{
+		float dist = std::sqrt(distSqr);
+		contact.normal = outside / dist;
+		contact.depth = b.radius - dist;
+		return true;
+	}
+
+	float exitX = a.extents.x - std::abs(delta.x);
+	float exitY = a.extents.y - std::abs(delta.y);
+	if (exitX < exitY)
+	{
+		contact.normal = { delta.x < 0.0f ? -1.0f : 1.0f, 0.0f };
+		contact.depth = exitX + b.radius;
+	}
+	else
 	{
-		auto [nudge, body] = GetWorld().GetComponents<PhysicsNudge, PhysicsBody>(entity);
-		body.velocity = body.velocity + nudge.velocity * time.dt();
+		contact.normal = { 0.0f, delta.y < 0.0f ? -1.0f : 1.0f };
+		contact.depth = exitY + b.radius;
 	}
+	return true;
 }
@@ -1,31 +1,198 @@
 ﻿#pragma once
 
+#include <bitset>
+#include <optional>
+
 #include "components.h"
 #include "ecs.h"
 #include "gamemap.h"
+#include "spatial.h"
 #include "types.h"
 
 struct GameMap;
 
+// Ray cast against the solid tiles of the map, the direction doesn't have to be normalized
+struct Ray
+{
+	Vec2 origin{};
+	Vec2 direction{};
+	float maxDistance = std::numeric_limits<float>::max();
+};
+
+struct RaycastHit
+{
+	bool hit = false;
+	int tileX{}, tileY{};
+	Vec2 point{};
+	Vec2 normal{};		// Outward normal of the tile side that was hit, zero when the ray starts inside a solid tile
+	float distance{};
+};
+
+// Overlap between two colliders, normal points from a to b and depth is how far they have to separate along it
+struct Contact
+{
+	Entity a{};
+	Entity b{};
+	Vec2 normal{};
+	float depth{};
+};
+
+// Moves bodies by their velocity in two passes. Bodies with a box collider are first swept against the tile map, which clips their velocity,
+// then the awake bodies are integrated. While most bodies are awake and the storage is ordered that is a SIMD kernel over the owned position and velocity spans.
+// Bodies moving slower than kSleepSpeed for kSleepTicks ticks in a row fall asleep and leave the awake list the per body passes iterate,
+// so a sleeper costs nothing until Wake puts it back. PhysicsBodyVelocitySystem wakes bodies asked to move differently from when they fell asleep
+// and CollisionSystem wakes both bodies of a contact involving an awake body. Sleepers also skip tile collision, they still push
+// awake bodies in PhysicsNudgeSystem but aren't pushed themselves, an awake body getting within nudge range wakes them instead.
 struct PhysicsSystem final : System<PhysicsSystem, Transform, PhysicsBody>
 {
+	static constexpr float kSleepSpeed = 0.05f;
+	static constexpr uint16_t kSleepTicks = 60;
+
+	static bool IsAsleep(uint16_t stillTicks) { return stillTicks >= kSleepTicks; }
+
+	void OnRegistered() override;
+	void OnEntityAdded(Entity entity) override;
+	void OnEntityRemoved(Entity entity) override;
 	void SetMap(GameMapHandle mapHandle);
 	void Update(const GameTime& time);
+	void Wake(Entity entity);
+	// Wakes both bodies of every contact with at least one awake body, sleepers resting against each other stay asleep
+	void WakeContacts(std::span<const Contact> contacts);
+	int GetAwakeCount() const { return awakeCount; }
 	bool MapSolid(const Vec2& point) const;
 	bool MapSolid(const Bounds2D& bounds, const Vec2& velocity = vec2::Zero) const;
 
+	// Returns whether the box hit a solid tile moving by velocity and the velocity that takes it as far as it can go, sliding along walls
+	std::pair<bool, Vec2> SweepTiles(Bounds2D bounds, Vec2 velocity) const;
+
+	// Returns the first solid tile along the ray. Thread safe, batches of rays are split across the job workers when large.
+	RaycastHit Raycast(const Ray& ray) const;
+	void Raycast(std::span<const Ray> rays, std::span<RaycastHit> hits) const;
+
 private:
+	float SweepAxis(float leadEdge, float move, float spanMin, float spanMax, bool horizontal, bool& blocked) const;
+	void GatherAwakeBodies();
+	template <typename TileColliderQuery>
+	void ResolveTiles(TileColliderQuery& query);
+	void Integrate();
+	void CountStillTicks(float sleepDistance);
+
+	Query<Reject<Prefab>, Transform, PhysicsBody, Collider::Box, Optional<DebugMarker>>* tileColliderQuery{};
+	Query<Reject<Prefab>, Transform, PhysicsBody, Shared<Collider::Box>, Optional<DebugMarker>>* sharedTileColliderQuery{};
 	GameMapHandle activeMapHandle{};
 	GameMap* activeMap = nullptr;
 	GameMapTileLayer* activeSolidLayer = nullptr;
+	std::vector<std::optional<Color>> missingMarkerColors;
+	// Query indices of the awake bodies in ascending order and the entity at each, only remapped when entities join or leave the query
+	std::vector<QueryBase::Index> awakeIndices;
+	std::vector<Entity> awakeEntities;
+	bool isAwakeListStale = false;
+	// Bodies woken or added since the last update, merged into the awake list by GatherAwakeBodies
+	std::vector<Entity> wokenEntities;
+	std::bitset<kMaxEntities> awakeFlags;
+	int awakeCount{};
 };
 
 struct PhysicsBodyVelocitySystem final : System<PhysicsBodyVelocitySystem, Velocity, PhysicsBody>
 {
 	void Update(const GameTime& time);
+
+	// Wakes sleeping bodies whose Velocity changed, bodies don't sleep without it
+	PhysicsSystem* physicsSystem{};
 };
 
-struct PhysicsNudgeSystem final : System<PhysicsNudgeSystem, Transform, PhysicsNudge, PhysicsBody>
+struct PhysicsNudgeSystem final : System<PhysicsNudgeSystem, Transform, Shared<PhysicsNudge>, PhysicsBody>
 {
+	void OnRegistered() override;
 	void Update(const GameTime& time);
+
+	// Wakes sleeping bodies within nudge range of an awake body, sleepers stay asleep without it
+	PhysicsSystem* physicsSystem{};
+
+private:
+	// Spatial index item, bodies with their own PhysicsNudge and bodies sharing one are gathered into the same index
+	struct NudgeBody
+	{
+		PhysicsNudge nudge;
+		Entity entity{};
+		QueryBase::Index index{};
+		bool isShared{};
+		bool isAsleep{};
+	};
+
+	template <typename NudgeQuery>
+	void InsertBodies(NudgeQuery& query, bool isShared);
+
+	Query<Reject<Prefab>, Transform, PhysicsNudge, PhysicsBody>* nudgeQuery{};
+	std::vector<NudgeBody> nudgeBodies;
+	SpatialIndex spatialIndex;
+	// Sleepers within range of the awake bodies of each chunk of sorted bodies, woken in chunk order after the parallel pass
+	std::vector<std::vector<Entity>> chunkSleepers;
+};
+
+// Collides box and circle colliders of different entities against each other, the tile map is handled by PhysicsSystem.
+// Every collider becomes a proxy with world space bounds, the proxies are sorted on their left edge and swept along x for candidate pairs
+// which are filtered by PhysicsLayer before the shape test. Contacts are rebuilt every update, read them with GetContacts.
+// Overlaps involving a Trigger are kept in a sorted pair set instead, comparing it to the previous update's set gives the begin and end events.
+// The begin events are also kept until the next update, read them with GetTriggerBegins to act on overlaps in the tick they started.
+// The sweep is split into fixed size chunks of sorted proxies run in parallel, results are appended in chunk order so they match a serial sweep.
+struct CollisionSystem final : System<CollisionSystem, Transform, Shared<Collider::Box>, Optional<PhysicsLayer>, Optional<Trigger>>
+{
+	void OnRegistered() override;
+	void Update();
+
+	std::span<const Contact> GetContacts() const { return contacts; }
+	std::span<const TriggerBegin> GetTriggerBegins() const { return triggerBegins; }
+
+	// Bodies in contact with an awake body are woken when set
+	PhysicsSystem* physicsSystem{};
+
+private:
+	enum class ShapeType : uint8_t
+	{
+		Box,
+		Circle,
+	};
+
+	struct Proxy
+	{
+		Bounds2D bounds;
+		Vec2 center;
+		Vec2 extents;
+		float radius{};
+		Entity entity{};
+		ShapeType shape{};
+		PhysicsLayerFlags layer{};
+		PhysicsLayerFlags collidesWith{};
+		bool isTrigger{};
+	};
+
+	struct TriggerPair
+	{
+		Entity trigger{};
+		Entity other{};
+
+		auto operator<=>(const TriggerPair& other) const = default;
+	};
+
+	void AddProxy(Entity entity, Vec2 position, const Collider::Box& box, const PhysicsLayer* layer, const Trigger* trigger);
+	void AddProxy(Entity entity, Vec2 position, const Collider::Circle& circle, const PhysicsLayer* layer, const Trigger* trigger);
+	struct SweepChunk
+	{
+		std::vector<Contact> contacts;
+		std::vector<TriggerPair> triggerPairs;
+	};
+
+	void Sweep(size_t first, size_t last, SweepChunk& chunk) const;
+	static bool Collide(const Proxy& a, const Proxy& b, Contact& contact);
+	void SendTriggerEvents();
+
+	Query<Reject<Prefab>, Transform, Collider::Box, Optional<PhysicsLayer>, Optional<Trigger>>* boxQuery{};
+	Query<Reject<Prefab>, Transform, Collider::Circle, Optional<PhysicsLayer>, Optional<Trigger>>* circleQuery{};
+	std::vector<Proxy> proxies;
+	std::vector<SweepChunk> sweepChunks;
+	std::vector<Contact> contacts;
+	std::vector<TriggerPair> triggerPairs;
+	std::vector<TriggerPair> previousTriggerPairs;
+	std::vector<TriggerBegin> triggerBegins;
 };
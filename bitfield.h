@@ -3,6 +3,66 @@
 #include <array>
 #include <bit>
 #include <cstdint>
+#include <format>
+#include <iterator>
+#include <string>
+#include <type_traits>
+
+// Bitfields of 64 bit chunks are processed a whole SIMD register at a time when the chunk count fills registers exactly.
+// AVX2 is used when the compiler targets it, otherwise SSE2 which every x64 target has.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BITFIELD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BITFIELD_SSE2 1
+#endif
+
+namespace bitfield_simd
+{
+#if defined(BITFIELD_AVX2)
+	using lane = __m256i;
+	constexpr size_t kLaneBytes = 32;
+
+	inline lane load(const uint64_t* chunks) { return _mm256_loadu_si256(reinterpret_cast<const lane*>(chunks)); }
+	inline void store(uint64_t* chunks, lane v) { _mm256_storeu_si256(reinterpret_cast<lane*>(chunks), v); }
+	inline lane bit_and(lane a, lane b) { return _mm256_and_si256(a, b); }
+	inline lane bit_or(lane a, lane b) { return _mm256_or_si256(a, b); }
+	inline lane bit_xor(lane a, lane b) { return _mm256_xor_si256(a, b); }
+	inline bool is_zero(lane v) { return _mm256_testz_si256(v, v); }
+	inline bool equal(lane a, lane b) { return is_zero(bit_xor(a, b)); }
+	// (a & b) == b
+	inline bool contains(lane a, lane b) { return _mm256_testc_si256(a, b); }
+	// (a & b) == 0
+	inline bool disjoint(lane a, lane b) { return _mm256_testz_si256(a, b); }
+	// One bit per 64 bit chunk, set when the chunk is zero
+	inline int zero_chunk_mask(lane v)
+	{
+		return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, _mm256_setzero_si256())));
+	}
+#elif defined(BITFIELD_SSE2)
+	using lane = __m128i;
+	constexpr size_t kLaneBytes = 16;
+
+	inline lane load(const uint64_t* chunks) { return _mm_loadu_si128(reinterpret_cast<const lane*>(chunks)); }
+	inline void store(uint64_t* chunks, lane v) { _mm_storeu_si128(reinterpret_cast<lane*>(chunks), v); }
+	inline lane bit_and(lane a, lane b) { return _mm_and_si128(a, b); }
+	inline lane bit_or(lane a, lane b) { return _mm_or_si128(a, b); }
+	inline lane bit_xor(lane a, lane b) { return _mm_xor_si128(a, b); }
+	inline bool equal(lane a, lane b) { return _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) == 0xFFFF; }
+	inline bool is_zero(lane v) { return equal(v, _mm_setzero_si128()); }
+	// (a & b) == b
+	inline bool contains(lane a, lane b) { return equal(bit_and(a, b), b); }
+	// (a & b) == 0
+	inline bool disjoint(lane a, lane b) { return is_zero(bit_and(a, b)); }
+	// One bit per 64 bit chunk, set when the chunk is zero. SSE2 has no 64 bit compare so both 32 bit halves are combined
+	inline int zero_chunk_mask(lane v)
+	{
+		int halves = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, _mm_setzero_si128())));
+		return (halves & (halves >> 1) & 1) | ((halves >> 2) & (halves >> 3) & 1) << 1;
+	}
+#endif
+}
 
 template <size_t N, typename T = uint64_t>
 struct bitfield
@@ -11,9 +71,53 @@ struct bitfield
 	static constexpr size_t CHUNK_SIZE = sizeof(T) * 8;
 	static constexpr size_t CHUNK_COUNT = (N % CHUNK_SIZE == 0) ? N / CHUNK_SIZE : N / CHUNK_SIZE + 1;
 
+#if defined(BITFIELD_AVX2) || defined(BITFIELD_SSE2)
+	static constexpr size_t CHUNKS_PER_LANE = bitfield_simd::kLaneBytes / sizeof(T);
+	static constexpr bool SIMD = std::is_same_v<T, uint64_t> && CHUNK_COUNT % CHUNKS_PER_LANE == 0;
+	static constexpr size_t ALIGNMENT = SIMD ? bitfield_simd::kLaneBytes : alignof(T);
+#else
+	static constexpr bool SIMD = false;
+	static constexpr size_t ALIGNMENT = alignof(T);
+#endif
+
+	// Yields the index of every set bit in ascending order. The range holds a copy of the chunks so it can iterate temporaries.
+	struct bit_range
+	{
+		struct iterator
+		{
+			using value_type = int;
+			using difference_type = std::ptrdiff_t;
+
+			const std::array<T, CHUNK_COUNT>* chunks = nullptr;
+			size_t chunkIndex = 0;
+			T remaining{};
+
+			int operator*() const { return std::countr_zero(remaining) + static_cast<int>(chunkIndex * CHUNK_SIZE); }
+			iterator& operator++() { remaining &= remaining - 1; skip_empty(); return *this; }
+			iterator operator++(int) { iterator it = *this; ++*this; return it; }
+			bool operator==(std::default_sentinel_t) const { return chunkIndex == CHUNK_COUNT; }
+
+			void skip_empty()
+			{
+				while (remaining == 0 && ++chunkIndex < CHUNK_COUNT)
+					remaining = (*chunks)[chunkIndex];
+			}
+		};
+
+		iterator begin() const
+		{
+			iterator it{ &chunks, 0, chunks[0] };
+			it.skip_empty();
+			return it;
+		}
+		std::default_sentinel_t end() const { return {}; }
+
+		std::array<T, CHUNK_COUNT> chunks;
+	};
+
 	bitfield() : chunks() {}
 	explicit bitfield(T chunk) : chunks() { chunks[0] = chunk; }
-	explicit bitfield(const std::array<T, N>& values) : chunks(values){}
+	explicit bitfield(const std::array<T, CHUNK_COUNT>& values) : chunks(values){}
 
 	void reset()
 	{
@@ -38,16 +142,96 @@ struct bitfield
 			chunk &= ~mask;
 	}
 
-	bool test(int bit)
+	bool test(int bit) const
 	{
-		auto [chunk, mask] = chunk_mask(bit);
-		return (chunk & mask) == mask;
+		int chunkIndex = bit / CHUNK_SIZE;
+		int chunkBit = bit - (chunkIndex * CHUNK_SIZE);
+		return (chunks[chunkIndex] >> chunkBit) & static_cast<T>(1);
 	}
 
-	bool empty() const { return lowest() < 0; }
+	bool empty() const
+	{
+#if defined(BITFIELD_AVX2) || defined(BITFIELD_SSE2)
+		if constexpr (SIMD)
+		{
+			for (size_t i = 0; i < CHUNK_COUNT; i += CHUNKS_PER_LANE)
+			{
+				if (!bitfield_simd::is_zero(bitfield_simd::load(&chunks[i])))
+					return false;
+			}
+			return true;
+		}
+#endif
+		for (size_t i = 0; i < CHUNK_COUNT; ++i)
+		{
+			if (chunks[i] != 0)
+				return false;
+		}
+		return true;
+	}
+
+	// Every bit set in other is also set in this
+	bool contains_all(const bitfield<N, T>& other) const
+	{
+#if defined(BITFIELD_AVX2) || defined(BITFIELD_SSE2)
+		if constexpr (SIMD)
+		{
+			for (size_t i = 0; i < CHUNK_COUNT; i += CHUNKS_PER_LANE)
+			{
+				if (!bitfield_simd::contains(bitfield_simd::load(&chunks[i]), bitfield_simd::load(&other.chunks[i])))
+					return false;
+			}
+			return true;
+		}
+#endif
+		for (size_t i = 0; i < CHUNK_COUNT; ++i)
+		{
+			if ((chunks[i] & other.chunks[i]) != other.chunks[i])
+				return false;
+		}
+		return true;
+	}
+
+	// At least one bit is set in both
+	bool intersects(const bitfield<N, T>& other) const
+	{
+#if defined(BITFIELD_AVX2) || defined(BITFIELD_SSE2)
+		if constexpr (SIMD)
+		{
+			for (size_t i = 0; i < CHUNK_COUNT; i += CHUNKS_PER_LANE)
+			{
+				if (!bitfield_simd::disjoint(bitfield_simd::load(&chunks[i]), bitfield_simd::load(&other.chunks[i])))
+					return true;
+			}
+			return false;
+		}
+#endif
+		for (size_t i = 0; i < CHUNK_COUNT; ++i)
+		{
+			if ((chunks[i] & other.chunks[i]) != 0)
+				return true;
+		}
+		return false;
+	}
 
 	int lowest() const
 	{
+#if defined(BITFIELD_AVX2) || defined(BITFIELD_SSE2)
+		if constexpr (SIMD)
+		{
+			constexpr int laneMask = (1 << CHUNKS_PER_LANE) - 1;
+			for (size_t i = 0; i < CHUNK_COUNT; i += CHUNKS_PER_LANE)
+			{
+				int nonZero = ~bitfield_simd::zero_chunk_mask(bitfield_simd::load(&chunks[i])) & laneMask;
+				if (nonZero != 0)
+				{
+					size_t chunkIndex = i + std::countr_zero(static_cast<unsigned>(nonZero));
+					return std::countr_zero(chunks[chunkIndex]) + static_cast<int>(chunkIndex * CHUNK_SIZE);
+				}
+			}
+			return -1;
+		}
+#endif
 		for (size_t i = 0; i < CHUNK_COUNT; ++i)
 		{
 			if (chunks[i] != 0)
@@ -58,14 +242,16 @@ struct bitfield
 
 	int highest() const
 	{
-		for (size_t i = CHUNK_COUNT - 1; i >= 0; --i)
+		for (size_t i = CHUNK_COUNT; i-- > 0;)
 		{
 			if (chunks[i] != 0)
-				return (CHUNK_SIZE - std::countl_zero(chunks[i]) - 1) + static_cast<int>(i * CHUNK_SIZE);
+				return static_cast<int>(CHUNK_SIZE - std::countl_zero(chunks[i]) - 1) + static_cast<int>(i * CHUNK_SIZE);
 		}
 		return -1;
 	}
 
+	bit_range bits() const { return { chunks }; }
+
 	bool operator[](int bit) const { return test(bit); }
 
 	bitfield<N, T>& operator&=(const bitfield<N, T>& other) { *this = *this & other; return *this; }
@@ -74,18 +260,54 @@ struct bitfield
 
 	constexpr size_t hash() const
 	{
-		size_t res = 17;
+		// Every chunk goes through a multiply so bits in different chunks don't cancel out
+		uint64_t res = 17;
 		for (size_t c = 0; c < CHUNK_COUNT; ++c)
-			res *= 31 + std::hash<T>()(chunks[c]);
-		return res;
+		{
+			res = (res ^ static_cast<uint64_t>(chunks[c])) * 0x9E3779B97F4A7C15ull;
+			res ^= res >> 32;
+		}
+		return static_cast<size_t>(res);
 	}
 
-	std::array<T, CHUNK_COUNT> chunks{};
+	alignas(ALIGNMENT) std::array<T, CHUNK_COUNT> chunks{};
 };
 
+namespace bitfield_simd
+{
+	// Applies a lane wise binary operation to whole bitfields, returns false when the bitfield isn't SIMD sized so the caller falls back to scalar chunks
+	template <size_t N, typename T, typename Op>
+	bool apply(bitfield<N, T>& result, const bitfield<N, T>& a, const bitfield<N, T>& b, Op op)
+	{
+#if defined(BITFIELD_AVX2) || defined(BITFIELD_SSE2)
+		if constexpr (bitfield<N, T>::SIMD)
+		{
+			for (size_t i = 0; i < bitfield<N, T>::CHUNK_COUNT; i += bitfield<N, T>::CHUNKS_PER_LANE)
+				store(&result.chunks[i], op(load(&a.chunks[i]), load(&b.chunks[i])));
+			return true;
+		}
+#endif
+		return false;
+	}
+}
+
 template <size_t N, typename T = uint64_t>
 constexpr bool operator==(const bitfield<N, T>& a, const bitfield<N, T>& b)
 {
+#if defined(BITFIELD_AVX2) || defined(BITFIELD_SSE2)
+	if constexpr (bitfield<N, T>::SIMD)
+	{
+		if (!std::is_constant_evaluated())
+		{
+			for (size_t i = 0; i < bitfield<N, T>::CHUNK_COUNT; i += bitfield<N, T>::CHUNKS_PER_LANE)
+			{
+				if (!bitfield_simd::equal(bitfield_simd::load(&a.chunks[i]), bitfield_simd::load(&b.chunks[i])))
+					return false;
+			}
+			return true;
+		}
+	}
+#endif
 	for (size_t i = 0; i < bitfield<N, T>::CHUNK_COUNT; ++i)
 	{
 		if (a.chunks[i] != b.chunks[i])
@@ -97,18 +319,17 @@ constexpr bool operator==(const bitfield<N, T>& a, const bitfield<N, T>& b)
 template <size_t N, typename T = uint64_t>
 constexpr bool operator!=(const bitfield<N, T>& a, const bitfield<N, T>& b)
 {
-	for (size_t i = 0; i < bitfield<N, T>::CHUNK_COUNT; ++i)
-	{
-		if (a.chunks[i] != b.chunks[i])
-			return true;
-	}
-	return false;
+	return !(a == b);
 }
 
 template <size_t N, typename T = uint64_t>
 constexpr bitfield<N, T> operator&(const bitfield<N, T>& a, const bitfield<N, T>& b)
 {
 	bitfield<N, T> result;
+#if defined(BITFIELD_AVX2) || defined(BITFIELD_SSE2)
+	if (!std::is_constant_evaluated() && bitfield_simd::apply(result, a, b, [](auto x, auto y) { return bitfield_simd::bit_and(x, y); }))
+		return result;
+#endif
 	for (size_t i = 0; i < bitfield<N, T>::CHUNK_COUNT; ++i)
 		result.chunks[i] = a.chunks[i] & b.chunks[i];
 	return result;
@@ -118,6 +339,10 @@ template <size_t N, typename T = uint64_t>
 constexpr bitfield<N, T> operator|(const bitfield<N, T>& a, const bitfield<N, T>& b)
 {
 	bitfield<N, T> result;
+#if defined(BITFIELD_AVX2) || defined(BITFIELD_SSE2)
+	if (!std::is_constant_evaluated() && bitfield_simd::apply(result, a, b, [](auto x, auto y) { return bitfield_simd::bit_or(x, y); }))
+		return result;
+#endif
 	for (size_t i = 0; i < bitfield<N, T>::CHUNK_COUNT; ++i)
 		result.chunks[i] = a.chunks[i] | b.chunks[i];
 	return result;
@@ -127,6 +352,10 @@ template <size_t N, typename T = uint64_t>
 constexpr bitfield<N, T> operator^(const bitfield<N, T>& a, const bitfield<N, T>& b)
 {
 	bitfield<N, T> result;
+#if defined(BITFIELD_AVX2) || defined(BITFIELD_SSE2)
+	if (!std::is_constant_evaluated() && bitfield_simd::apply(result, a, b, [](auto x, auto y) { return bitfield_simd::bit_xor(x, y); }))
+		return result;
+#endif
 	for (size_t i = 0; i < bitfield<N, T>::CHUNK_COUNT; ++i)
 		result.chunks[i] = a.chunks[i] ^ b.chunks[i];
 	return result;
@@ -151,9 +380,11 @@ struct std::formatter<bitfield<N, uint64_t>> : std::formatter<std::string>
 {
 	auto format(bitfield<N, uint64_t> bf, format_context& ctx) const
 	{
-		if constexpr (bitfield<N, uint64_t>::CHUNK_COUNT == 1)
-			return std::formatter<string>::format(std::format("{:016x}", bf.chunks[0]), ctx);
-		else if constexpr (bitfield<N, uint64_t>::CHUNK_COUNT == 2)
-			return std::formatter<string>::format(std::format("{:016x}{:016x}", bf.chunks[1], bf.chunks[0]), ctx);
+		// Highest chunk first so the string reads as one big hex number
+		std::string hex;
+		hex.reserve(bitfield<N, uint64_t>::CHUNK_COUNT * 16);
+		for (size_t i = bitfield<N, uint64_t>::CHUNK_COUNT; i-- > 0;)
+			std::format_to(std::back_inserter(hex), "{:016x}", bf.chunks[i]);
+		return std::formatter<string>::format(hex, ctx);
 	}
 };
@@ -18,16 +18,64 @@ struct Transform
 	float rotation = 0.0f;
 };
 
+template <>
+struct soa_layout<Transform>
+{
+	static constexpr auto fields = std::make_tuple(&Transform::position, &Transform::scale, &Transform::rotation);
+
+	struct Ref
+	{
+		Vec2& position;
+		Vec2& scale;
+		float& rotation;
+	};
+};
+
 struct Velocity
 {
 	Vec2 velocity{};
 };
 
+template <>
+struct soa_layout<Velocity>
+{
+	static constexpr auto fields = std::make_tuple(&Velocity::velocity);
+
+	struct Ref
+	{
+		Vec2& velocity;
+	};
+};
+
 struct Facing
 {
 	Direction facing{};
 };
 
+// Transform position at the start of the current fixed simulation tick, rendering interpolates from it to Transform by GameTime::alpha.
+// Only captured values are interpolated from so spawned and pooled entities don't slide in from where their prefab was, see TransformHistorySystem
+struct PreviousTransform
+{
+	Vec2 position = vec2::Zero;
+	bool isCaptured = false;
+};
+
+// Attaches the entity to a parent entity, its Transform is then derived from its LocalTransform every frame by TransformHierarchySystem.
+// Changes must be made through TransformHierarchySystem::SetParent or by removing and re-adding the component.
+struct Parent
+{
+	Entity entity{};
+};
+
+// Transform relative to the parent's Transform.
+// Changes must be made through TransformHierarchySystem::SetLocalTransform or followed by MarkDirty to be propagated.
+struct LocalTransform
+{
+	Vec2 position = vec2::Zero;
+	Vec2 scale = vec2::One;
+	float rotation = 0.0f;
+};
+
 // Input
 struct GameInputGather
 {
@@ -74,6 +122,7 @@ struct PlayerShootControl
 {
 	float cooldownSec{};
 	float cooldownRemaining{};
+	Entity bulletPrefab{};
 };
 
 // Enemies
@@ -82,6 +131,11 @@ struct EnemyTag
 	
 };
 
+// Bullets are triggers, they despawn on the first enemy they hit or on reaching a solid tile
+struct BulletTag
+{
+};
+
 struct Spawner
 {
 	Entity prefab{};
@@ -96,10 +150,33 @@ struct SpawnSource
 	Entity source;
 };
 
+// Event sent through world.Events<EnemyKilled>(), source is the spawner that spawned the enemy or 0
+struct EnemyKilled
+{
+	Entity enemy{};
+	Entity source{};
+};
+
 // Physics/Collision
+// Bodies that barely move for a while fall asleep, see PhysicsSystem. Sleeping only changes these fields, never the body's components.
 struct PhysicsBody
 {
 	Vec2 velocity{};
+	Vec2 restVelocity{};		// Velocity requested before tile collision, a sleeping body wakes when the request moves away from it
+	uint16_t stillTicks{};		// Consecutive ticks moving slower than the sleep speed, asleep once it reaches PhysicsSystem::kSleepTicks
+};
+
+template <>
+struct soa_layout<PhysicsBody>
+{
+	static constexpr auto fields = std::make_tuple(&PhysicsBody::velocity, &PhysicsBody::restVelocity, &PhysicsBody::stillTicks);
+
+	struct Ref
+	{
+		Vec2& velocity;
+		Vec2& restVelocity;
+		uint16_t& stillTicks;
+	};
 };
 
 struct Collider
@@ -108,6 +185,8 @@ struct Collider
 	{
 		Vec2 center{};
 		Vec2 extents = vec2::Half;
+
+		bool operator==(const Box& other) const = default;
 	};
 
 	struct Circle
@@ -117,15 +196,44 @@ struct Collider
 	};
 };
 
+enum class PhysicsLayerFlags : uint16_t
+{
+	None = 0,
+	Default = 1,
+	Player = 2,
+	Enemy = 4,
+	Bullet = 8,
+	All = 0xFFFF,
+};
+
+// Two colliders only touch when each is on a layer the other collides with. Entities without a PhysicsLayer are on Default and collide with everything
 struct PhysicsLayer
 {
-	uint16_t layer;
+	PhysicsLayerFlags layer = PhysicsLayerFlags::Default;
+	PhysicsLayerFlags collidesWith = PhysicsLayerFlags::All;
 };
 
+// Colliders of an entity with a Trigger don't produce contacts, their overlaps are reported through TriggerBegin and TriggerEnd events instead
 struct Trigger
 {
 };
 
+// Sent by CollisionSystem once when a trigger starts overlapping another collider and once when it stops.
+// An overlap also ends when either entity is destroyed or disabled so TriggerEnd can refer to entities that are gone.
+// Events are read a tick after they were sent, by then an entity may have been released and reacquired or its id reused.
+// Use CollisionSystem::GetTriggerBegins to act on an overlap in the tick it started.
+struct TriggerBegin
+{
+	Entity trigger{};
+	Entity other{};
+};
+
+struct TriggerEnd
+{
+	Entity trigger{};
+	Entity other{};
+};
+
 struct DebugMarker
 {
 	Color color{};
@@ -136,7 +244,8 @@ struct PhysicsNudge
 	float radius = 0.5f;
 	float minStrength = 0.01f;
 	float maxStrength{};
-	Vec2 velocity{};
+
+	bool operator==(const PhysicsNudge& other) const = default;
 };
 
 // Rendering
@@ -152,6 +261,8 @@ struct SpriteRender
 	int16_t spriteId{};
 	SpriteFlipFlags flipFlags{};
 	Vec2 origin{};
+
+	bool operator==(const SpriteRender& other) const = default;
 };
 
 struct GameMapRender
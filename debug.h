@@ -5,6 +5,7 @@
 #include <format>
 #include <functional>
 #include <map>
+#include <memory>
 #include <ranges>
 #include <typeindex>
 #include <unordered_map>
@@ -4,32 +4,47 @@
 // https://austinmorlan.com/posts/entity_component_system
 
 
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
 #include <format>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
 #include <optional>
 #include <queue>
 #include <ranges>
 #include <set>
-#include <stack>
+#include <span>
 #include <unordered_map>
 
 #include "bitfield.h"
+#include "enumflag.h"
+#include "events.h"
 #include "types.h"
 
 #ifndef ENABLE_ECS_LOGGING
 #define ENABLE_ECS_LOGGING 0
 #endif
 
-#if ENABLE_ECS_LOGGING
+// Records fixed size binary events into a ring buffer, see ecs::trace below
+#ifndef ENABLE_ECS_TRACE
+#define ENABLE_ECS_TRACE 0
+#endif
+
+#if ENABLE_ECS_LOGGING || ENABLE_ECS_TRACE
 #include "debug.h"
+#endif
 
-namespace ecs
-{
-	using debug::Log;
-}
+// Arguments to ECS_LOG are only evaluated when logging is enabled so building strings for it is free when disabled
+#if ENABLE_ECS_LOGGING
+#define ECS_LOG(...) ::debug::Log(__VA_ARGS__)
 #else
-namespace ecs { template <typename... Args> void Log(std::string_view fmt, Args&&... args) {} }
+#define ECS_LOG(...) ((void)0)
 #endif
 
 class World;
@@ -38,17 +53,57 @@ constexpr Entity kMaxEntities = 4096;
 constexpr Entity kEntityArraySize = kMaxEntities + 1;
 constexpr Entity kInvalidEntity = 0;
 
-using ComponentType = uint8_t;
-constexpr ComponentType kMaxComponents = 64;
+// Maps entities of a staging world to the entities they became in the world they were merged into
+using EntityRemap = std::unordered_map<Entity, Entity>;
+
+// Number of distinct component types a world can register, signature layers are this many bits wide.
+// Multiples of 256 keep every signature layer a whole number of AVX2 registers, see bitfield.h
+#ifndef ECS_MAX_COMPONENTS
+#define ECS_MAX_COMPONENTS 256
+#endif
+
+using ComponentType = uint16_t;
+constexpr ComponentType kMaxComponents = ECS_MAX_COMPONENTS;
+static_assert(kMaxComponents % 64 == 0, "ECS_MAX_COMPONENTS must be a multiple of 64.");
 
 // Built in components
 ///////////////////////////////////////////////////
 struct Prefab {};
 
+// Disabled is only ever a signature bit and has no component storage, toggle it with World::SetEnabled.
+// Every query rejects disabled entities unless it explicitly requires Disabled.
+struct Disabled {};
+
+// Added to entities created through World::Acquire so they can be returned to the pool of the prefab they were cloned from
+struct Pooled { Entity prefab; };
+
 // Reject<Component> to ignore entities containing that component
 // e.g. Reject<Prefab> is very common (and built-in to all systems) as prefabs are intended to be cloned but not actually a part of the simulation
 template <typename T>
 struct Reject { using Component = T; };
+
+// Optional<Component> to match entities whether or not they contain that component
+// The query caches a pointer to the component that is null when the entity doesn't have it and is refreshed when the component is added or removed
+template <typename T>
+struct Optional { using Component = T; };
+
+// Shared<Component> is a handle to a deduplicated, refcounted value stored once for all entities using it.
+// Create one with Share(value) for every component added and change it on an entity with World::SetShared, the value itself is immutable.
+template <typename T>
+struct Shared
+{
+	const T* value = nullptr;
+
+	const T& operator*() const { return *value; }
+	const T* operator->() const { return value; }
+};
+
+// Reads a component the same way whether a query matched it as T or as Shared<T>
+template <typename T>
+const T& ComponentValue(const T& component) { return component; }
+
+template <typename T>
+const T& ComponentValue(const Shared<T>& shared) { return *shared; }
 ///////////////////////////////////////////////////
 
 template <class T, template <class...> class Template>
@@ -63,6 +118,70 @@ struct is_reject_component : is_specialization<T, Reject> {};
 template <typename T>
 inline constexpr bool is_reject_component_v = is_reject_component<T>::value;
 
+template <typename T>
+struct is_optional_component : is_specialization<T, Optional> {};
+
+template <typename T>
+inline constexpr bool is_optional_component_v = is_optional_component<T>::value;
+
+// Specialize soa_layout to store a component as one aligned array per field instead of one array of structs.
+// fields is a tuple of member pointers and Ref is an aggregate of references to those members declared in the same order.
+// Component access returns a Ref by value instead of T& so code binding components with auto& must use auto instead.
+template <typename T>
+struct soa_layout {};
+
+template <typename T>
+struct is_soa_component : std::bool_constant<requires { typename soa_layout<T>::Ref; soa_layout<T>::fields; }> {};
+
+template <typename T>
+inline constexpr bool is_soa_component_v = is_soa_component<T>::value;
+
+// component_reference_t<Transform> = soa_layout<Transform>::Ref, component_reference_t<Facing> = Facing&
+template <typename T, bool = is_soa_component_v<T>>
+struct component_reference { using type = T&; };
+
+template <typename T>
+struct component_reference<T, true> { using type = typename soa_layout<T>::Ref; };
+
+template <typename T>
+using component_reference_t = typename component_reference<T>::type;
+
+template <typename T>
+struct member_pointer_traits;
+
+template <typename C, typename V>
+struct member_pointer_traits<V C::*>
+{
+	using class_type = C;
+	using value_type = V;
+};
+
+// Index of Member in soa_layout<T>::fields, or the field count if it isn't one
+template <typename T, auto Member, size_t I = 0>
+constexpr size_t soa_field_index()
+{
+	using Fields = std::decay_t<decltype(soa_layout<T>::fields)>;
+	if constexpr (I >= std::tuple_size_v<Fields>)
+		return I;
+	else if constexpr (std::is_same_v<std::tuple_element_t<I, Fields>, decltype(Member)>)
+		return std::get<I>(soa_layout<T>::fields) == Member ? I : soa_field_index<T, Member, I + 1>();
+	else
+		return soa_field_index<T, Member, I + 1>();
+}
+
+template <typename T>
+class ComponentArray;
+
+// Query list entry for a soa_layout component, the component's position in its ComponentArray
+template <typename T>
+struct soa_component_ref
+{
+	ComponentArray<T>* array;
+	size_t index;
+
+	typename soa_layout<T>::Ref get() const { return array->GetAtIndex(index); }
+};
+
 template <typename... T>
 struct component_reject_filter;
 
@@ -81,7 +200,7 @@ struct component_reject_filter<T>
 template <typename T, typename... Ts>
 struct component_reject_filter<T, Ts...>
 {
-	using type = decltype(std::tuple_cat(component_reject_filter<T>::type(), component_reject_filter<Ts...>::type()));
+	using type = decltype(std::tuple_cat(std::declval<typename component_reject_filter<T>::type>(), std::declval<typename component_reject_filter<Ts...>::type>()));
 };
 
 // component_reject_filter_t<Reject<Prefab>, Transform, Reject<PlayerTag>, Size, Color> = std::tuple<Transform, Size, Color>
@@ -97,6 +216,18 @@ inline constexpr size_t component_reject_filter_size_v = component_reject_filter
 template <typename T>
 using component_ref_vector_t = std::vector<std::reference_wrapper<T>>;
 
+template <typename T>
+struct component_list { using type = std::conditional_t<is_soa_component_v<T>, std::vector<soa_component_ref<T>>, component_ref_vector_t<T>>; };
+
+template <typename T>
+struct component_list<Optional<T>> { using type = std::vector<T*>; };
+
+// List type a query stores for a component term
+// component_list_t<Facing> = std::vector<std::reference_wrapper<Facing>>, component_list_t<Optional<Facing>> = std::vector<Facing*>
+// component_list_t<Transform> = std::vector<soa_component_ref<Transform>> as Transform has a soa_layout
+template <typename T>
+using component_list_t = typename component_list<T>::type;
+
 template <typename... T>
 struct component_ref_vector_reject_filter;
 
@@ -109,7 +240,7 @@ struct component_ref_vector_reject_filter<>
 template <typename T>
 struct component_ref_vector_reject_filter<T>
 {
-	using type = typename std::conditional_t<not is_reject_component_v<T>, std::tuple<component_ref_vector_t<T>>, std::tuple<>>;
+	using type = typename std::conditional_t<not is_reject_component_v<T>, std::tuple<component_list_t<T>>, std::tuple<>>;
 };
 
 template <typename T, typename... Ts>
@@ -121,6 +252,7 @@ struct component_ref_vector_reject_filter<T, Ts...>
 // vector of references to all component types specified by T except Reject<Component>s
 // component_ref_vector_reject_filter_t<Reject<Prefab>, Transform, Size> = std::tuple<std::vector<Transform&>, std::vector<Size&>>
 // Note that the references are actually std::reference_wrapper<T> since raw references can't be used on vector but they function exactly the same as references
+// Optional<Component>s are stored as vectors of pointers instead
 template <typename... T>
 using component_ref_vector_reject_filter_t = typename component_ref_vector_reject_filter<T...>::type;
 
@@ -133,26 +265,33 @@ struct Signature
 
 	Layer require;
 	Layer reject;
+	// Optional components never affect matching, queries use this layer to know which component changes require refreshing cached pointers
+	Layer optional;
 
-	void reset() { require.reset(); reject.reset(); }
+	void reset() { require.reset(); reject.reset(); optional.reset(); }
 	bool Matches(const Signature& other) const
 	{
-		return (require & other.require) == require &&
-			(reject & other.require).empty();
+		return other.require.contains_all(require) &&
+			!reject.intersects(other.require);
 	}
 
 	Signature& operator|=(const Signature& other)
 	{
 		require |= other.require;
 		reject |= other.reject;
+		optional |= other.optional;
 		return *this;
 	}
 };
 
-inline bool operator==(const Signature& a, const Signature& b) { return a.require == b.require && a.reject == b.reject; }
+inline bool operator==(const Signature& a, const Signature& b) { return a.require == b.require && a.reject == b.reject && a.optional == b.optional; }
 inline bool operator<(const Signature& a, const Signature& b)
 {
-	return (a.require < b.require) || ((a.require == b.require) && a.reject < b.reject);
+	if (a.require != b.require)
+		return a.require < b.require;
+	if (a.reject != b.reject)
+		return a.reject < b.reject;
+	return a.optional < b.optional;
 }
 
 template<>
@@ -163,6 +302,7 @@ struct std::hash<Signature>
 		size_t res = 17;
 		res = res * 31 + signature.require.hash();
 		res = res * 31 + signature.reject.hash();
+		res = res * 31 + signature.optional.hash();
 		return res;
 	}
 };
@@ -180,6 +320,92 @@ struct std::formatter<Signature> : std::formatter<std::string>
 void LogSignature(const World& world, Signature signature);
 void LogCompareSignatures(const World& world, const char* label1, Signature signature1, const char* label2, Signature signature2);
 
+// Structured tracing of ECS operations.
+// Events are fixed size records written into a ring buffer and only formatted into strings when the buffer is dumped.
+// ECS_TRACE compiles to nothing when ENABLE_ECS_TRACE is off so its arguments are never evaluated.
+#if ENABLE_ECS_TRACE
+namespace ecs::trace
+{
+	enum class EventType : uint8_t
+	{
+		CreateEntity,
+		DestroyEntity,
+		CloneEntity,
+		AddComponent,
+		RemoveComponent,
+		CreateQuery,
+		QueryMatch,
+		QueryUnmatch,
+	};
+
+	struct Event
+	{
+		uint32_t sequence{};
+		EventType type{};
+		ComponentType componentType{};
+		Entity entity{};
+		int32_t arg{};
+		Signature signature{};
+	};
+
+	constexpr int kBufferSize = 1024;
+
+	struct Buffer
+	{
+		ring_buf<Event, kBufferSize> events{};
+		uint32_t nextSequence = 1;
+	};
+
+	inline Buffer& GetBuffer()
+	{
+		static Buffer buffer;
+		return buffer;
+	}
+
+	inline void Record(EventType type, Entity entity, int32_t arg = 0, ComponentType componentType = 0, const Signature& signature = {})
+	{
+		Buffer& buffer = GetBuffer();
+		*buffer.events.next() = Event{ buffer.nextSequence++, type, componentType, entity, arg, signature };
+	}
+
+	inline void Clear() { GetBuffer() = {}; }
+
+	void Dump(const World& world);
+}
+
+#define ECS_TRACE(type, ...) ::ecs::trace::Record(::ecs::trace::EventType::type, __VA_ARGS__)
+#else
+#define ECS_TRACE(...) ((void)0)
+#endif
+
+// Entity ids are allocated from a reserved range per category so entities with similar lifetimes get neighbouring ids.
+// Query entity lists are sorted by id, keeping long lived entities out of the transient range keeps the churning part of every list packed together.
+enum class EntityCategory
+{
+	Static,		// Created once, prefabs, camera, map, player
+	LongLived,	// Lives for a level, spawners
+	Transient,	// Bullets, spawned enemies and other short lived instances
+	Count,
+};
+
+// Ids in [first, last)
+struct EntityIdRange
+{
+	Entity first{};
+	Entity last{};
+};
+
+using EntityCategoryRanges = enum_array<EntityIdRange, EntityCategory>;
+
+inline EntityCategoryRanges DefaultEntityCategoryRanges()
+{
+	EntityCategoryRanges ranges;
+	ranges[EntityCategory::Static] = { 1, 256 };
+	ranges[EntityCategory::LongLived] = { 256, 1024 };
+	ranges[EntityCategory::Transient] = { 1024, kMaxEntities };
+	return ranges;
+}
+
 // Tracks available entity indices and signatures of active entities
 class EntityManager
 {
@@ -187,43 +413,78 @@ public:
 	EntityManager(World& world)
 		: world(world)
 	{
-		for (Entity entity = kMaxEntities - 1; entity >= 1; --entity)
-			availableEntities.push(entity);
+		SetCategoryRanges(DefaultEntityCategoryRanges());
+	}
+
+	// Ranges must not overlap and can only be changed while no entities exist
+	void SetCategoryRanges(const EntityCategoryRanges& ranges)
+	{
+		ASSERT(activeEntities.empty() && "Entity category ranges changed while entities exist.");
+
+		categoryRanges = ranges;
+		for (EntityCategory category = EntityCategory::Static; category < EntityCategory::Count; ++category)
+		{
+			const EntityIdRange& range = categoryRanges[category];
+			ASSERT(range.first >= 1 && range.first <= range.last && range.last <= kMaxEntities && "Invalid entity category range.");
+
+			// Ascending ids are already a valid min heap
+			std::vector<Entity> ids(range.last - range.first);
+			std::iota(ids.begin(), ids.end(), range.first);
+			availableEntities[category] = AvailableIds(std::greater<Entity>(), std::move(ids));
+		}
 	}
 
-	Entity CreateEntity()
+	// Reuses the lowest free id of the category. A full category borrows from the next one, which only costs locality.
+	Entity CreateEntity(EntityCategory category = EntityCategory::LongLived)
 	{
-		ASSERT(!availableEntities.empty() && "Max entities reached.");
+		EntityCategory allocationCategory = category;
+		for (int attempt = 1; availableEntities[allocationCategory].empty() && attempt < static_cast<int>(EntityCategory::Count); ++attempt)
+			allocationCategory = static_cast<EntityCategory>((static_cast<int>(category) + attempt) % static_cast<int>(EntityCategory::Count));
 
-		Entity entity = availableEntities.top();
-		availableEntities.pop();
+		ASSERT(!availableEntities[allocationCategory].empty() && "Max entities reached.");
+
+		Entity entity = availableEntities[allocationCategory].top();
+		availableEntities[allocationCategory].pop();
 
 		activeEntities.emplace(entity);
+		ECS_TRACE(CreateEntity, entity);
 
 		return entity;
 	}
 
 	template <int N>
-	std::array<Entity, N> CreateEntities()
+	std::array<Entity, N> CreateEntities(EntityCategory category = EntityCategory::LongLived)
 	{
 		std::array<Entity, N> entities;
 		for (int i = 0; i < N; ++i)
 		{
-			entities[i] = CreateEntity();
+			entities[i] = CreateEntity(category);
 		}
 		return entities;
 	}
 
 	void DestroyEntity(Entity entity)
 	{
-		ecs::Log("[EntityManager] DestroyEntity {}", entity);
+		ECS_TRACE(DestroyEntity, entity);
 		ASSERT(entity < kMaxEntities && "Invalid entity.");
 
 		signatures[entity].reset();
-		availableEntities.push(entity);
+		availableEntities[GetEntityCategory(entity)].push(entity);
 		activeEntities.erase(entity);
 	}
 
+	// The category whose range contains the entity, not necessarily the one it was created with if that category was full
+	EntityCategory GetEntityCategory(Entity entity) const
+	{
+		for (EntityCategory category = EntityCategory::Static; category < EntityCategory::Count; ++category)
+		{
+			if (entity >= categoryRanges[category].first && entity < categoryRanges[category].last)
+				return category;
+		}
+		ASSERT(false && "Entity outside of every category range.");
+		return EntityCategory::Transient;
+	}
+
 	void SetSignature(Entity entity, Signature signature)
 	{
 		ASSERT(entity < kMaxEntities && "Invalid entity.");
@@ -243,6 +504,11 @@ public:
 		return static_cast<Entity>(activeEntities.size());
 	}
 
+	bool IsActive(Entity entity) const
+	{
+		return activeEntities.contains(entity);
+	}
+
 	constexpr const std::set<Entity>& GetActiveEntities() const { return activeEntities; }
 
 	std::vector<Entity> GetEntitiesMatchingSignature(Signature signature) const
@@ -250,23 +516,200 @@ public:
 		std::vector<Entity> entities;
 		for (Entity entity : activeEntities)
 		{
-			if (Signature entitySignature = GetSignature(entity); signature.Matches(entitySignature))
-			{
-				ecs::Log("New Query {} matches Entity {}", signature, entity);
-				LogCompareSignatures(world, "New Query Match", signature, "Entity", entitySignature);
+			if (signature.Matches(GetSignature(entity)))
 				entities.emplace_back(entity);
-			}
 		}
 		return entities;
 	}
 
 private:
-	std::stack<Entity> availableEntities{};
+	using AvailableIds = std::priority_queue<Entity, std::vector<Entity>, std::greater<Entity>>;
+
+	EntityCategoryRanges categoryRanges{};
+	enum_array<AvailableIds, EntityCategory> availableEntities{};
 	std::set<Entity> activeEntities;
 	std::array<Signature, kEntityArraySize> signatures{};
 	World& world;
 };
 
+// Storage for the values referenced by Shared<T> handles.
+// Values live at stable addresses in a fixed size array and a slot is freed when the last component referencing it is removed.
+// The store is shared by every World so staging worlds populated on other threads serialize through its mutex.
+// Lookups take the reference they hand out under the same lock so another thread releasing the value can't free the slot in between.
+template <typename T>
+class SharedComponentStore
+{
+public:
+	static constexpr int32_t kCapacity = 256;
+
+	static SharedComponentStore& Get()
+	{
+		static SharedComponentStore store;
+		return store;
+	}
+
+	// Returns the stored value equal to value, adding it if there is none.
+	// The returned handle holds a reference which the component it is added to takes over, see Attach.
+	// A handle that is never added to a component keeps its value stored.
+	const T* Intern(const T& value)
+	{
+		std::scoped_lock lock(mutex);
+
+		int32_t slot = FindOrAdd(value);
+		refCounts[slot]++;
+		pendingRefs[slot]++;
+		return &values[slot];
+	}
+
+	// Moves a component's reference from previous, which may be null, to the stored value equal to value and returns it
+	const T* Exchange(const T* previous, const T& value)
+	{
+		std::scoped_lock lock(mutex);
+
+		int32_t slot = FindOrAdd(value);
+		refCounts[slot]++;
+		if (previous)
+			ReleaseSlot(IndexOf(previous));
+		return &values[slot];
+	}
+
+	// A handle from Intern was added to a component, which takes over the reference the handle holds
+	void Attach(const T* value)
+	{
+		std::scoped_lock lock(mutex);
+
+		int32_t slot = IndexOf(value);
+		ASSERT(pendingRefs[slot] > 0 && "Shared handle added to more than one component, Share the value for every add.");
+		if (pendingRefs[slot] > 0)
+			pendingRefs[slot]--;
+		else
+			refCounts[slot]++;
+	}
+
+	// A component referencing value was copied from another component
+	void AddRef(const T* value)
+	{
+		std::scoped_lock lock(mutex);
+
+		int32_t slot = IndexOf(value);
+		ASSERT(used[slot] && "Shared value was already released.");
+		refCounts[slot]++;
+	}
+
+	void Release(const T* value)
+	{
+		std::scoped_lock lock(mutex);
+
+		ReleaseSlot(IndexOf(value));
+	}
+
+	int32_t IndexOf(const T* value) const
+	{
+		ASSERT(value >= values.data() && value < values.data() + kCapacity && "Value not owned by shared component store.");
+		return static_cast<int32_t>(value - values.data());
+	}
+
+	const T* GetValue(int32_t slot) const { return &values[slot]; }
+
+	int32_t GetRefCount(const T* value) const
+	{
+		std::scoped_lock lock(mutex);
+
+		return refCounts[IndexOf(value)];
+	}
+
+private:
+	// Slot of the stored value equal to value, a new slot is used with a reference count of 0 so the caller must reference it before unlocking
+	int32_t FindOrAdd(const T& value)
+	{
+		int32_t freeSlot = -1;
+		for (int32_t slot = 0; slot < slotCount; ++slot)
+		{
+			if (!used[slot])
+			{
+				if (freeSlot < 0)
+					freeSlot = slot;
+			}
+			else if (Equals(values[slot], value))
+				return slot;
+		}
+
+		if (freeSlot < 0)
+		{
+			ASSERT(slotCount < kCapacity && "Shared component store full.");
+			freeSlot = slotCount++;
+		}
+
+		values[freeSlot] = value;
+		refCounts[freeSlot] = 0;
+		pendingRefs[freeSlot] = 0;
+		used[freeSlot] = true;
+		return freeSlot;
+	}
+
+	void ReleaseSlot(int32_t slot)
+	{
+		ASSERT(refCounts[slot] > 0 && "Shared component released too many times.");
+		if (--refCounts[slot] == 0)
+			used[slot] = false;
+	}
+
+	static bool Equals(const T& a, const T& b)
+	{
+		if constexpr (std::equality_comparable<T>)
+			return a == b;
+		else
+			return std::memcmp(&a, &b, sizeof(T)) == 0;
+	}
+
+	std::array<T, kCapacity> values{};
+	std::array<int32_t, kCapacity> refCounts{};
+	std::array<int32_t, kCapacity> pendingRefs{};	// References held by handles from Intern that weren't added to a component yet
+	std::array<bool, kCapacity> used{};
+	int32_t slotCount = 0;
+	mutable std::mutex mutex;
+};
+
+template <typename T>
+Shared<T> Share(const T& value)
+{
+	return Shared<T>{ SharedComponentStore<T>::Get().Intern(value) };
+}
+
+// Ranges of query indices whose Shared<T> component references the same value, filled by Query::GroupByShared
+template <typename T>
+struct SharedGroups
+{
+	struct Group
+	{
+		const T* value;
+		int32_t begin;
+		int32_t end;
+	};
+
+	std::vector<int32_t> indices;
+	std::vector<Group> groups;
+};
+
+// Called by ComponentArray whenever a component value enters or leaves storage.
+// Specialize for component types that need to track their live values.
+// OnAdd is called for components added from a value passed in by the caller, OnCopy for components copied from another entity or world.
+template <typename T>
+struct component_hooks
+{
+	static void OnAdd(const T& component) {}
+	static void OnCopy(const T& component) {}
+	static void OnRemove(const T& component) {}
+};
+
+template <typename T>
+struct component_hooks<Shared<T>>
+{
+	static void OnAdd(const Shared<T>& shared) { if (shared.value) SharedComponentStore<T>::Get().Attach(shared.value); }
+	static void OnCopy(const Shared<T>& shared) { if (shared.value) SharedComponentStore<T>::Get().AddRef(shared.value); }
+	static void OnRemove(const Shared<T>& shared) { if (shared.value) SharedComponentStore<T>::Get().Release(shared.value); }
+};
+
 class IComponentArray
 {
 public:
@@ -276,52 +719,192 @@ public:
 	virtual void* TryGetUntypedComponentPtr(Entity entity) = 0;
 	virtual size_t GetComponentSize() = 0;
 	virtual void* InsertUntyped(Entity entity, const void* source, size_t size) = 0;
+	virtual void InsertCopy(Entity source, Entity destination) = 0;
+	virtual void Copy(Entity source, Entity destination) = 0;
+	virtual size_t GetIndex(Entity entity) const = 0;
+	virtual void SwapIndices(size_t first, size_t second) = 0;
+	virtual void MoveFrom(IComponentArray& source, const EntityRemap& remap) = 0;
 };
 
+// Default component storage, one contiguous array of T.
+// Slots are raw memory so components are constructed in place and destroyed when removed, ComponentArray tracks which slots are live.
 template <typename T>
-class ComponentArray final : public IComponentArray
+struct aos_component_storage
 {
-public:
-	void* InsertUntyped(Entity entity, const void* source, size_t sourceSize) override
+	template <typename... Args>
+	void Construct(size_t index, Args&&... args)
 	{
-		ASSERT(!entityToIndexMap.contains(entity) && "Component already added to entity.");
+		std::construct_at(Slot(index), std::forward<Args>(args)...);
+	}
 
-		size_t newIndex = size++;
-		entityToIndexMap[entity] = newIndex;
-		indexToEntityMap[newIndex] = entity;
+	void Destroy(size_t index)
+	{
+		std::destroy_at(&Get(index));
+	}
+
+	T& Get(size_t index) { return *std::launder(Slot(index)); }
+	const T& Load(size_t index) const { return *std::launder(reinterpret_cast<const T*>(data + index * sizeof(T))); }
+	void Store(size_t index, const T& value) { Get(index) = value; }
 
-		std::memcpy(&componentArray[newIndex], source, sourceSize);
-		return &componentArray[newIndex];
+	// Moves the live component at from into the empty slot at to, leaving from empty
+	void Relocate(size_t from, size_t to)
+	{
+		if constexpr (std::is_trivially_copyable_v<T>)
+		{
+			std::memcpy(Slot(to), Slot(from), sizeof(T));
+		}
+		else
+		{
+			std::construct_at(Slot(to), std::move(Get(from)));
+			Destroy(from);
+		}
 	}
 
-	T& Insert(Entity entity, const T& component)
+private:
+	T* Slot(size_t index) { return reinterpret_cast<T*>(data + index * sizeof(T)); }
+
+	alignas(T) std::byte data[sizeof(T) * kEntityArraySize];
+};
+
+constexpr size_t kSoAFieldAlignment = 64;
+
+// Storage for components with a soa_layout, one array per field.
+// Index 0 is never used by a component so each array is padded such that index 1, the first component, starts on a cache line.
+template <typename T>
+struct soa_component_storage
+{
+	using Fields = std::decay_t<decltype(soa_layout<T>::fields)>;
+	static constexpr size_t kFieldCount = std::tuple_size_v<Fields>;
+
+	template <size_t I>
+	using field_t = typename member_pointer_traits<std::tuple_element_t<I, Fields>>::value_type;
+
+	template <typename F>
+	struct alignas(kSoAFieldAlignment) FieldArray
 	{
-		ASSERT(!entityToIndexMap.contains(entity) && "Component already added to entity.");
+		static_assert(sizeof(F) <= kSoAFieldAlignment, "soa_layout field is larger than the field alignment.");
 
-		size_t newIndex = size++;
-		entityToIndexMap[entity] = newIndex;
-		indexToEntityMap[newIndex] = entity;
-		componentArray[newIndex] = component;
+		std::byte padding[kSoAFieldAlignment - sizeof(F)]{};
+		std::array<F, kEntityArraySize> data{};
+	};
+
+	template <typename... Args>
+	void Construct(size_t index, Args&&... args)
+	{
+		Store(index, T(std::forward<Args>(args)...));
+	}
+
+	void Destroy(size_t index) {}
+
+	typename soa_layout<T>::Ref Get(size_t index)
+	{
+		return std::apply([index](auto&... fieldArrays) { return typename soa_layout<T>::Ref{ fieldArrays.data[index]... }; }, fieldArrays);
+	}
+
+	T Load(size_t index) const
+	{
+		T value{};
+		ForEachField([&](auto field) { value.*std::get<field>(soa_layout<T>::fields) = std::get<field>(fieldArrays).data[index]; });
+		return value;
+	}
+
+	void Store(size_t index, const T& value)
+	{
+		ForEachField([&](auto field) { std::get<field>(fieldArrays).data[index] = value.*std::get<field>(soa_layout<T>::fields); });
+	}
+
+	void Relocate(size_t from, size_t to)
+	{
+		ForEachField([&](auto field) { std::get<field>(fieldArrays).data[to] = std::get<field>(fieldArrays).data[from]; });
+	}
+
+	template <size_t I>
+	field_t<I>* FieldData() { return std::get<I>(fieldArrays).data.data(); }
+
+private:
+	template <typename F>
+	static void ForEachField(F&& f)
+	{
+		[&]<size_t... I>(std::index_sequence<I...>) { (f(std::integral_constant<size_t, I>{}), ...); }(std::make_index_sequence<kFieldCount>());
+	}
+
+	template <size_t... I>
+	static auto MakeFieldArrays(std::index_sequence<I...>) -> std::tuple<FieldArray<field_t<I>>...>;
+
+	decltype(MakeFieldArrays(std::make_index_sequence<kFieldCount>())) fieldArrays{};
+};
+
+template <typename T>
+class ComponentArray final : public IComponentArray
+{
+public:
+	using Storage = std::conditional_t<is_soa_component_v<T>, soa_component_storage<T>, aos_component_storage<T>>;
+
+	ComponentArray() = default;
+	ComponentArray(const ComponentArray&) = delete;
+	ComponentArray(ComponentArray&&) = delete;
+	ComponentArray& operator=(const ComponentArray&) = delete;
+	ComponentArray& operator=(ComponentArray&&) = delete;
+
+	~ComponentArray() override
+	{
+		for (size_t index = 1; index < size; ++index)
+			storage.Destroy(index);
+	}
+
+	void* InsertUntyped(Entity entity, const void* source, size_t sourceSize) override
+	{
+		ASSERT(sourceSize == sizeof(T) && "Component size mismatch.");
+		if constexpr (std::is_copy_constructible_v<T>)
+			Emplace(entity, *static_cast<const T*>(source));
+		else
+			ASSERT(false && "Component type is not copyable.");
+		return TryGetUntypedComponentPtr(entity);
+	}
 
-		return componentArray[newIndex];
+	void InsertCopy(Entity source, Entity destination) override
+	{
+		if constexpr (std::is_copy_constructible_v<T>)
+		{
+			if constexpr (is_soa_component_v<T>)
+				OnCopy(Construct(destination, storage.Load(GetIndex(source))));
+			else
+			{
+				// storage never reallocates so the source reference stays valid while the destination is constructed
+				const T& component = storage.Load(GetIndex(source));
+				OnCopy(Construct(destination, component));
+			}
+		}
+		else
+			ASSERT(false && "Component type is not copyable.");
 	}
 
-	T& GetDummyComponent() { return componentArray[0]; }
+	template <typename... Args>
+	component_reference_t<T> Emplace(Entity entity, Args&&... args)
+	{
+		size_t newIndex = Construct(entity, std::forward<Args>(args)...);
+		OnAdd(newIndex);
+
+		return storage.Get(newIndex);
+	}
 
 	void Remove(Entity entity)
 	{
-		ecs::Log("ComponentArray<{}> Remove {}", typeid(T).name() + 7, entity);
+		ECS_LOG("ComponentArray<{}> Remove {}", typeid(T).name() + 7, entity);
 
 
 		ASSERT(entityToIndexMap.contains(entity) && "Component missing for entity.");
 
-		// swap last element into removed index
+		// destroy the removed component and move the last element into its slot
 		// update mapping such that the removed index points to the swapped in entity
 		// and the swapped entity points to the removed index
 
 		size_t indexOfRemovedEntity = entityToIndexMap[entity];
 		size_t indexOfLastElement = size - 1;
-		componentArray[indexOfRemovedEntity] = componentArray[indexOfLastElement];
+		OnRemove(indexOfRemovedEntity);
+		storage.Destroy(indexOfRemovedEntity);
+		if (indexOfRemovedEntity != indexOfLastElement)
+			storage.Relocate(indexOfLastElement, indexOfRemovedEntity);
 
 		Entity entityOfLastElement = indexToEntityMap[indexOfLastElement];
 		entityToIndexMap[entityOfLastElement] = indexOfRemovedEntity;
@@ -334,15 +917,67 @@ public:
 		size--;
 	}
 
+	// Move constructs every component of source, an array of the same type in another world, onto the remapped entities.
+	// The moved from components are left in source to be removed with their entities.
+	void MoveFrom(IComponentArray& source, const EntityRemap& remap) override
+	{
+		ComponentArray& sourceArray = static_cast<ComponentArray&>(source);
+		for (size_t index = 1; index < sourceArray.size; ++index)
+		{
+			Entity entity = remap.at(sourceArray.indexToEntityMap[index]);
+			if constexpr (is_soa_component_v<T>)
+				OnCopy(Construct(entity, sourceArray.storage.Load(index)));
+			else
+				OnCopy(Construct(entity, std::move(sourceArray.storage.Get(index))));
+		}
+	}
+
 	bool Contains(Entity entity) const
 	{
 		return entityToIndexMap.contains(entity);
 	}
 
-	T& Get(Entity entity)
+	component_reference_t<T> Get(Entity entity)
+	{
+		return storage.Get(GetIndex(entity));
+	}
+
+	size_t GetIndex(Entity entity) const override
 	{
 		ASSERT(entityToIndexMap.contains(entity) && "Component missing for entity.");
-		return componentArray[entityToIndexMap[entity]];
+		return entityToIndexMap.at(entity);
+	}
+
+	component_reference_t<T> GetAtIndex(size_t index)
+	{
+		return storage.Get(index);
+	}
+
+	// Exchanges the storage slots of two components, slot 0 is never used by a component so it serves as the temporary
+	void SwapIndices(size_t first, size_t second) override
+	{
+		ASSERT(first > 0 && first < size && second > 0 && second < size && "Index out of component range.");
+		if (first == second)
+			return;
+
+		storage.Relocate(first, 0);
+		storage.Relocate(second, first);
+		storage.Relocate(0, second);
+
+		Entity firstEntity = indexToEntityMap[first];
+		Entity secondEntity = indexToEntityMap[second];
+		indexToEntityMap[first] = secondEntity;
+		indexToEntityMap[second] = firstEntity;
+		entityToIndexMap[firstEntity] = second;
+		entityToIndexMap[secondEntity] = first;
+	}
+
+	// Contiguous view of one soa_layout field for every stored component, indexed by GetIndex - 1
+	template <size_t Field>
+	auto GetFieldSpan()
+	{
+		static_assert(is_soa_component_v<T>, "Field spans are only available for soa_layout components.");
+		return std::span(storage.template FieldData<Field>() + 1, size - 1);
 	}
 
 	void OnEntityDestroyed(Entity entity) override
@@ -353,13 +988,22 @@ public:
 		}
 	}
 
+	// Components with a soa_layout have no contiguous T to point to
 	void* TryGetUntypedComponentPtr(Entity entity) override
 	{
-		if (entityToIndexMap.contains(entity))
+		if constexpr (is_soa_component_v<T>)
 		{
-			return &componentArray[entityToIndexMap[entity]];
+			ASSERT(false && "Untyped access is not supported for soa_layout components.");
+			return nullptr;
+		}
+		else
+		{
+			if (entityToIndexMap.contains(entity))
+			{
+				return &storage.Get(entityToIndexMap[entity]);
+			}
+			return nullptr;
 		}
-		return nullptr;
 	}
 
 	size_t GetComponentSize() override
@@ -367,8 +1011,57 @@ public:
 		return sizeof(T);
 	}
 
+	// Overwrites the destination's component value with the source's, does nothing unless both have the component
+	void Copy(Entity source, Entity destination) override
+	{
+		if (!entityToIndexMap.contains(source) || !entityToIndexMap.contains(destination))
+			return;
+
+		if constexpr (std::is_copy_assignable_v<T>)
+		{
+			size_t sourceIndex = entityToIndexMap[source];
+			size_t destinationIndex = entityToIndexMap[destination];
+			OnCopy(sourceIndex);
+			OnRemove(destinationIndex);
+			storage.Store(destinationIndex, storage.Load(sourceIndex));
+		}
+		else
+			ASSERT(false && "Component type is not copyable.");
+	}
+
 private:
-	std::array<T, kEntityArraySize> componentArray{};
+	template <typename... Args>
+	size_t Construct(Entity entity, Args&&... args)
+	{
+		ASSERT(!entityToIndexMap.contains(entity) && "Component already added to entity.");
+
+		size_t newIndex = size++;
+		entityToIndexMap[entity] = newIndex;
+		indexToEntityMap[newIndex] = entity;
+		storage.Construct(newIndex, std::forward<Args>(args)...);
+		return newIndex;
+	}
+
+	// component_hooks are not invoked for soa_layout components
+	void OnAdd(size_t index)
+	{
+		if constexpr (!is_soa_component_v<T>)
+			component_hooks<T>::OnAdd(storage.Get(index));
+	}
+
+	void OnCopy(size_t index)
+	{
+		if constexpr (!is_soa_component_v<T>)
+			component_hooks<T>::OnCopy(storage.Get(index));
+	}
+
+	void OnRemove(size_t index)
+	{
+		if constexpr (!is_soa_component_v<T>)
+			component_hooks<T>::OnRemove(storage.Get(index));
+	}
+
+	Storage storage{};
 	std::unordered_map<Entity, size_t> entityToIndexMap{};
 	std::unordered_map<size_t, Entity> indexToEntityMap{};
 	size_t size = 1;
@@ -393,14 +1086,16 @@ class ComponentManager
 public:
 
 	template <typename T>
-	auto RegisterComponent() -> std::enable_if_t<std::is_trivially_copyable_v<T>, ComponentId>
+	ComponentId RegisterComponent()
 	{
 		ComponentId componentId = GetComponentId<T>();
 		ASSERT(!componentTypes.contains(componentId) && "Component already registered.");
+		ASSERT(nextComponentType < kMaxComponents && "Too many component types, raise ECS_MAX_COMPONENTS.");
 		componentTypes.insert({ componentId, nextComponentType });
 		componentIds.insert({ nextComponentType, componentId });
 		componentNames.insert({ nextComponentType, GetComponentName<T>() });
 		componentArrays.insert({ componentId, std::make_shared<ComponentArray<T>>() });
+		componentArraysByType[nextComponentType] = componentArrays[componentId].get();
 		++nextComponentType;
 		return componentId;
 	}
@@ -419,10 +1114,10 @@ public:
 		return componentNames.at(componentType) + 7;
 	}
 
-	template <typename T>
-	T& AddComponent(Entity entity, const T& component)
+	template <typename T, typename... Args>
+	component_reference_t<T> EmplaceComponent(Entity entity, Args&&... args)
 	{
-		return GetComponentArray<T>()->Insert(entity, component);
+		return GetComponentArray<T>()->Emplace(entity, std::forward<Args>(args)...);
 	}
 
 	void* AddComponentUntyped(Entity entity, ComponentType componentType, const void* source, size_t size)
@@ -443,11 +1138,24 @@ public:
 	}
 
 	template <typename T>
-	T& GetComponent(Entity entity)
+	component_reference_t<T> GetComponent(Entity entity)
 	{
 		return GetComponentArray<T>()->Get(entity);
 	}
 
+	template <typename T>
+	soa_component_ref<T> GetSoAComponentRef(Entity entity)
+	{
+		std::shared_ptr<ComponentArray<T>> componentArray = GetComponentArray<T>();
+		return soa_component_ref<T>{ componentArray.get(), componentArray->GetIndex(entity) };
+	}
+
+	template <typename T, size_t Field>
+	auto GetComponentFieldSpan()
+	{
+		return GetComponentArray<T>()->template GetFieldSpan<Field>();
+	}
+
 	auto TryGetComponent(Entity entity, ComponentType type) -> std::pair<void*, size_t>
 	{
 		if (componentIds.contains(type))
@@ -458,12 +1166,58 @@ public:
 		return std::make_pair(nullptr, 0);
 	}
 
-	void OnEntityDestroyed(Entity entity)
+	// Adds the source's component of componentType to destination
+	void CloneComponent(Entity source, Entity destination, ComponentType componentType)
+	{
+		ASSERT(componentArraysByType[componentType] && "Component not registered.");
+		componentArraysByType[componentType]->InsertCopy(source, destination);
+	}
+
+	void CopyComponent(Entity source, Entity destination, ComponentType componentType)
+	{
+		ASSERT(componentArraysByType[componentType] && "Component not registered.");
+		componentArraysByType[componentType]->Copy(source, destination);
+	}
+
+	// Worlds can only exchange components when they registered the same component types in the same order
+	bool HasSameComponentTypes(const ComponentManager& other) const
+	{
+		return componentTypes == other.componentTypes;
+	}
+
+	void MoveComponentsFrom(ComponentManager& source, const EntityRemap& remap)
+	{
+		ASSERT(HasSameComponentTypes(source) && "Component registration differs between component managers.");
+		for (ComponentType componentType = 0; componentType < nextComponentType; ++componentType)
+			componentArraysByType[componentType]->MoveFrom(*source.componentArraysByType[componentType], remap);
+	}
+
+	// Swaps the entity's components of every type in layer into storage slot index, returns false if they were all already there
+	bool MoveComponentsToIndex(Entity entity, Signature::Layer layer, size_t index)
 	{
-		ecs::Log("[ComponentManager] OnEntityDestroyed {}", entity);
-		for (const auto& component : componentArrays | std::views::values)
+		bool moved = false;
+		for (int typeIndex : layer.bits())
 		{
-			component->OnEntityDestroyed(entity);
+			IComponentArray* componentArray = componentArraysByType[typeIndex];
+			ASSERT(componentArray && "Component not registered.");
+			if (size_t currentIndex = componentArray->GetIndex(entity); currentIndex != index)
+			{
+				componentArray->SwapIndices(currentIndex, index);
+				moved = true;
+			}
+		}
+		return moved;
+	}
+
+	// Only the component arrays of types set in the entity's signature are visited
+	void OnEntityDestroyed(Entity entity, const Signature& signature)
+	{
+		ECS_LOG("[ComponentManager] OnEntityDestroyed {}", entity);
+
+		for (int typeIndex : signature.require.bits())
+		{
+			ASSERT(componentArraysByType[typeIndex] && "Component not registered.");
+			componentArraysByType[typeIndex]->OnEntityDestroyed(entity);
 		}
 	}
 
@@ -478,14 +1232,11 @@ public:
 		std::string ret;
 		ret.reserve(128);
 
-		while (!layer.empty())
+		for (int typeIndex : layer.bits())
 		{
-			int typeIndex = layer.lowest();
-			ComponentType ctype = static_cast<ComponentType>(typeIndex);
-			ret += GetComponentTypeName(ctype);
-			layer.set(typeIndex, false);
-			if (!layer.empty())
+			if (!ret.empty())
 				ret += ", ";
+			ret += GetComponentTypeName(static_cast<ComponentType>(typeIndex));
 		}
 
 		return ret;
@@ -501,6 +1252,11 @@ private:
 			ComponentType ignoredType = GetComponentType<typename Head::Component>();
 			signature.reject.set(ignoredType, true);
 		}
+		else if constexpr (is_optional_component_v<Head>)
+		{
+			ComponentType optionalType = GetComponentType<typename Head::Component>();
+			signature.optional.set(optionalType, true);
+		}
 		else
 		{
 			ComponentType componentType = GetComponentType<Head>();
@@ -518,6 +1274,7 @@ private:
 	std::unordered_map<ComponentType, ComponentId> componentIds{};
 	std::unordered_map<ComponentType, const char*> componentNames{};
 	std::unordered_map<ComponentId, std::shared_ptr<IComponentArray>> componentArrays;
+	std::array<IComponentArray*, kMaxComponents> componentArraysByType{};
 	ComponentType nextComponentType{};
 
 	template <typename T>
@@ -568,6 +1325,9 @@ struct QueryBase  // NOLINT(cppcoreguidelines-special-member-functions)
 	const std::vector<Entity>& GetEntities() { return entities; }
 	Signature GetSignature() const { return signature; }
 
+	// True once every entity's required components are stored in query order, see World::OwnStorage
+	bool IsStorageOrdered() const { return ownsStorage && orderedCount == std::ssize(entities); }
+
 	Entity GetEntityAtIndex(Index index) const
 	{
 		ASSERT(index >= 0 && index < static_cast<Index>(entities.size()) && "Index out of query range.");
@@ -583,7 +1343,7 @@ struct QueryBase  // NOLINT(cppcoreguidelines-special-member-functions)
 		}
 
 		if (!entities.empty())
-			ecs::Log("Initialized query and added {} entities to it.", entities.size());
+			ECS_LOG("Initialized query and added {} entities to it.", entities.size());
 	}
 
 	void OnEntityMatch(Entity entity) const { callbacks.OnEntityMatch(entity); }
@@ -591,7 +1351,11 @@ struct QueryBase  // NOLINT(cppcoreguidelines-special-member-functions)
 
 	virtual void InsertLists(Index index, Entity entity) { ASSERT(false && "SHOULDNT HAPPEN"); }
 	virtual void RemoveLists(Index index) { ASSERT(false && "SHOULDNT HAPPEN"); }
+	virtual void MoveLists(Index from, Index to) { ASSERT(false && "SHOULDNT HAPPEN"); }
+	virtual void TruncateLists(Index size) { ASSERT(false && "SHOULDNT HAPPEN"); }
+	virtual void MergeLists(const std::vector<Entity>& previousEntities) { ASSERT(false && "SHOULDNT HAPPEN"); }
 	virtual void RefreshComponentReferences() { ASSERT(false); }
+	virtual void RefreshEntity(Entity entity) { ASSERT(false); }
 
 	virtual Index FindEntityIndex(Entity entity)
 	{
@@ -602,7 +1366,8 @@ struct QueryBase  // NOLINT(cppcoreguidelines-special-member-functions)
 	void AddEntity(Entity entity)
 	{
 		auto index = FindEntityIndex(entity);
-		ecs::Log("Query {} Add Entity {} at index {}", queryId, entity, index);
+		ECS_TRACE(QueryMatch, entity, queryId);
+		orderedCount = std::min(orderedCount, index);
 		entities.insert(entities.begin() + index, entity);
 		InsertLists(index, entity);
 		OnEntityMatch(entity);
@@ -611,17 +1376,81 @@ struct QueryBase  // NOLINT(cppcoreguidelines-special-member-functions)
 	void RemoveEntity(Entity entity)
 	{
 		auto index = FindEntityIndex(entity);
-		ecs::Log("Query {} Remove Entity {} from index {}", queryId, entity, index);
+		ECS_TRACE(QueryUnmatch, entity, queryId);
+		orderedCount = std::min(orderedCount, index);
 		entities.erase(entities.begin() + index);
 		RemoveLists(index);
 		OnEntityUnmatch(entity);
 	}
 
+	// Adds all of the sorted entities in a single merging pass over the entity and component lists
+	void AddEntities(std::span<const Entity> sortedEntities)
+	{
+		ASSERT(std::ranges::is_sorted(sortedEntities) && "Entities to add must be sorted.");
+		if (sortedEntities.empty())
+			return;
+
+		std::vector<Entity> previousEntities = std::move(entities);
+		entities.clear();
+		entities.reserve(previousEntities.size() + sortedEntities.size());
+		std::ranges::merge(previousEntities, sortedEntities, std::back_inserter(entities));
+
+		orderedCount = std::min(orderedCount, FindEntityIndex(sortedEntities.front()));
+		MergeLists(previousEntities);
+
+		for (Entity entity : sortedEntities)
+		{
+			ECS_TRACE(QueryMatch, entity, queryId);
+			OnEntityMatch(entity);
+		}
+	}
+
+	// Removes all of the sorted entities in a single compacting pass over the entity and component lists
+	void RemoveEntities(std::span<const Entity> sortedEntities)
+	{
+		ASSERT(std::ranges::is_sorted(sortedEntities) && "Entities to remove must be sorted.");
+
+		auto removed = sortedEntities.begin();
+		Index writeIndex = 0;
+		for (Index readIndex = 0; readIndex < std::ssize(entities); ++readIndex)
+		{
+			Entity entity = entities[readIndex];
+			while (removed != sortedEntities.end() && *removed < entity)
+				++removed;
+
+			if (removed != sortedEntities.end() && *removed == entity)
+			{
+				ECS_TRACE(QueryUnmatch, entity, queryId);
+				orderedCount = std::min(orderedCount, writeIndex);
+				continue;
+			}
+
+			if (writeIndex != readIndex)
+			{
+				entities[writeIndex] = entity;
+				MoveLists(readIndex, writeIndex);
+			}
+			++writeIndex;
+		}
+
+		ASSERT(entities.size() - writeIndex == sortedEntities.size() && "Entity did not exist in query.");
+		entities.erase(entities.begin() + writeIndex, entities.end());
+		TruncateLists(writeIndex);
+
+		for (Entity entity : sortedEntities)
+			OnEntityUnmatch(entity);
+	}
+
 	QueryId queryId;
 	std::vector<Entity> entities;
 	Signature signature;
 	QueryCallbacks callbacks;
 	World* world;
+
+	// Owning queries keep their required components co-sorted with the entity list,
+	// the components of the first orderedCount entities are stored at entity index + 1 in every owned component array.
+	bool ownsStorage = false;
+	Index orderedCount = 0;
 };
 
 template <typename... Components>
@@ -643,9 +1472,9 @@ struct Query : QueryBase
 	}
 
 	template <typename T>
-	auto GetComponentList() const -> std::enable_if_t<not is_reject_component_v<T> and std::disjunction_v<std::is_same<T, Components>...>, const component_ref_vector_t<T>&>
+	auto GetComponentList() const -> std::enable_if_t<not is_reject_component_v<T> and std::disjunction_v<std::is_same<T, Components>...>, const component_list_t<T>&>
 	{
-		return std::get<component_ref_vector_t<T>>(componentLists);
+		return std::get<component_list_t<T>>(componentLists);
 	}
 
 	auto GetComponentLists() const
@@ -656,27 +1485,79 @@ struct Query : QueryBase
 	template <typename T>
 	void LogComponentList(std::function<std::string(const T&)> componentToString)
 	{
+#if ENABLE_ECS_LOGGING
 		auto componentList = GetComponentList<T>();
 		std::string compListStr;
 		compListStr.reserve(256);
 		for (size_t i = 0; i < componentList.size(); ++i)
 		{
-			compListStr += componentToString(componentList[i]);
-			if (i < componentList.size() - 1)
-				compListStr += ", ";
+			compListStr += componentToString(componentList[i]);
+			if (i < componentList.size() - 1)
+				compListStr += ", ";
+		}
+		ECS_LOG("Components<{}> [{}]: {}", typeid(T).name(), componentList.size(), compListStr);
+#endif
+	}
+
+	template <typename T>
+	component_reference_t<T> GetComponentAtIndex(Index index) const
+	{
+		return GetComponentList<T>()[index].get();
+	}
+
+	// Null when the entity at index doesn't have the component
+	template <typename T>
+	T* GetOptionalComponentAtIndex(Index index) const
+	{
+		return GetComponentList<Optional<T>>()[index];
+	}
+
+	// Buckets the query's entity indices by the value of their Shared<T> component so entities sharing a value can be processed together
+	template <typename T>
+	void GroupByShared(SharedGroups<T>& grouping) const
+	{
+		constexpr int32_t kCapacity = SharedComponentStore<T>::kCapacity;
+		const SharedComponentStore<T>& store = SharedComponentStore<T>::Get();
+		const component_list_t<Shared<T>>& sharedList = GetComponentList<Shared<T>>();
+
+		std::array<int32_t, kCapacity + 1> offsets{};
+		for (const Shared<T>& shared : sharedList)
+			offsets[store.IndexOf(shared.value) + 1]++;
+
+		grouping.groups.clear();
+		for (int32_t slot = 0; slot < kCapacity; ++slot)
+		{
+			if (offsets[slot + 1] > 0)
+				grouping.groups.emplace_back(typename SharedGroups<T>::Group{ store.GetValue(slot), offsets[slot], offsets[slot] + offsets[slot + 1] });
+			offsets[slot + 1] += offsets[slot];
 		}
-		ecs::Log("Components<{}> [{}]: {}", typeid(T).name(), componentList.size(), compListStr);
+
+		grouping.indices.resize(sharedList.size());
+		for (int32_t index = 0; index < static_cast<int32_t>(sharedList.size()); ++index)
+			grouping.indices[offsets[store.IndexOf(sharedList[index].get().value)]++] = index;
 	}
 
-	template <typename T>
-	T& GetComponentAtIndex(Index index) const
+	// Contiguous view of one soa_layout field of a required component, element i belongs to the entity at index i.
+	// Only valid while IsStorageOrdered.
+	template <auto Member>
+	auto GetOwnedFieldSpan() const;
+
+	// Same layout as GetArchetype but read from the cached lists, Optional<T> terms are returned as T*
+	auto GetArchetypeAtIndex(Index index) const
 	{
-		return GetComponentList<T>()[index];
+		return std::apply([index](const auto&... lists)
+			{
+				return std::tuple<decltype(GetListElement(lists, index))...>(GetListElement(lists, index)...);
+			}, componentLists);
 	}
 
 	void InsertLists(Index index, Entity entity) override;
 	void RemoveLists(Index index) override;
+	void MoveLists(Index from, Index to) override;
+	void TruncateLists(Index size) override;
+	void MergeLists(const std::vector<Entity>& previousEntities) override;
 	void RefreshComponentReferences() override;
+	void RefreshEntity(Entity entity) override;
 
 	template <typename T>
 	auto GetFirstListHelper() const
@@ -684,7 +1565,7 @@ struct Query : QueryBase
 		if constexpr (is_reject_component_v<T>)
 			return std::tuple<>();
 		else
-			return std::tuple<component_ref_vector_t<T>>(GetComponentList<T>());
+			return std::tuple<component_list_t<T>>(GetComponentList<T>());
 	}
 
 	template <typename Head, typename... Tail>
@@ -697,6 +1578,15 @@ struct Query : QueryBase
 	}
 
 private:
+	template <typename T>
+	static T& GetListElement(const component_ref_vector_t<T>& list, Index index) { return list[index].get(); }
+
+	template <typename T>
+	static typename soa_layout<T>::Ref GetListElement(const std::vector<soa_component_ref<T>>& list, Index index) { return list[index].get(); }
+
+	template <typename T>
+	static T* GetListElement(const std::vector<T*>& list, Index index) { return list[index]; }
+
 	component_ref_vector_reject_filter_t<Components...> componentLists;
 };
 
@@ -710,6 +1600,10 @@ public:
 	template <class... Components> Query<Components...>* GetQueryById(QueryId queryId);
 
 	void OnEntitySignatureChanged(Entity entity, Signature newSignature, Signature oldSignature);
+	void OnEntitiesDestroyed(std::span<const Entity> entities, const EntityManager& entityManager);
+	void OnEntitiesAdded(std::span<const Entity> entities, const EntityManager& entityManager);
+	void OwnStorage(QueryId queryId);
+	void ReorderOwnedStorage(ComponentManager& componentManager, std::chrono::steady_clock::time_point deadline);
 	void BeginComponentRefUpdates();
 	void ApplyComponentRefUpdates();
 private:
@@ -719,8 +1613,11 @@ private:
 	std::set<Signature> signatures;
 	std::unordered_map<QueryId, std::unique_ptr<QueryBase>> queries;
 	std::unordered_map<Signature, std::vector<QueryId>> queriesBySignature;
+	std::vector<QueryId> owningQueries;
+	Signature::Layer ownedComponents;
 	bool areComponentRefsUpdating = false;
 	std::set<QueryId> pendingRefUpdateQueries;
+	Signature::Layer pendingMovedComponents;
 };
 
 enum class SystemFlags
@@ -730,6 +1627,13 @@ enum class SystemFlags
 	MonitorGlobalEntityDestroy = 1 << 1,
 };
 
+// The part of a system's entities to update this tick when the schedule spreads the system over several ticks
+struct SystemSlice
+{
+	int index = 0;
+	int count = 1;
+};
+
 struct SystemBase  // NOLINT(cppcoreguidelines-special-member-functions)
 {
 	virtual ~SystemBase();
@@ -744,9 +1648,13 @@ struct SystemBase  // NOLINT(cppcoreguidelines-special-member-functions)
 
 	SystemFlags Flags() const;
 
+	void SetSlice(SystemSlice slice) { currentSlice = slice; }
+	SystemSlice GetSlice() const { return currentSlice; }
+
 private:
 	World* world{};
 	SystemFlags flags = SystemFlags::None;
+	SystemSlice currentSlice{};
 };
 
 inline SystemBase::~SystemBase() = default;
@@ -762,7 +1670,10 @@ struct System : SystemBase
 	auto GetSystemQuery();
 	static auto Register(World& world, SystemFlags systemFlags = SystemFlags::None);
 	auto GetArchetype(Entity entity) const;
+	auto GetArchetypeAtIndex(QueryBase::Index index);
 	const std::vector<Entity>& GetEntities();
+	// Entity index range [first, second) of the current slice, all entities unless the schedule slices the system
+	std::pair<QueryBase::Index, QueryBase::Index> GetSliceRange();
 	Query<Reject<Prefab>, Components...>* systemQuery{};
 };
 
@@ -849,73 +1760,217 @@ public:
 		: entityManager(*this)
 		, queryManager(*this)
 	{
-		RegisterComponent<Prefab>();
+		RegisterComponents<Prefab, Disabled, Pooled>();
 	}
 
-	Entity CreateEntity()
+	Entity CreateEntity(EntityCategory category = EntityCategory::LongLived)
 	{
-		return entityManager.CreateEntity();
+		return entityManager.CreateEntity(category);
 	}
 
 	template <int N>
-	std::array<Entity, N> CreateEntities()
+	std::array<Entity, N> CreateEntities(EntityCategory category = EntityCategory::LongLived)
 	{
-		return entityManager.CreateEntities<N>();
+		return entityManager.CreateEntities<N>(category);
 	}
 
-	std::vector<Entity> CreateEntities(size_t entityCount)
+	std::vector<Entity> CreateEntities(size_t entityCount, EntityCategory category = EntityCategory::LongLived)
 	{
 		std::vector<Entity> result;
 		for (size_t i = 0; i < entityCount; ++i)
-			result.emplace_back(entityManager.CreateEntity());
+			result.emplace_back(entityManager.CreateEntity(category));
 		return result;
 	}
 
-	Entity CloneEntity(Entity entity)
+	void SetEntityCategoryRanges(const EntityCategoryRanges& ranges)
+	{
+		entityManager.SetCategoryRanges(ranges);
+	}
+
+	// Clones are instances of prefabs so they default to the transient range.
+	// A clone starts enabled and outside any pool, Prefab, Disabled and Pooled are not copied. Acquire adds Pooled to the clones it makes.
+	Entity CloneEntity(Entity entity, EntityCategory category = EntityCategory::Transient)
 	{
 		if (!entity)
 			return 0;
 
-		Entity newEntity = CreateEntity();
+		Entity newEntity = CreateEntity(category);
 
 		Signature signature = entityManager.GetSignature(entity);
 		Signature newSignature{};
-		ecs::Log("Clone Entity {} -> {}", entity, newEntity, signature);
-		ecs::Log("    Require: {}", componentManager.BuildSignatureLayerString(signature.require));
-		ecs::Log("    Reject: {}", componentManager.BuildSignatureLayerString(signature.reject));
-		int nextTypeIndex = signature.require.lowest();
-		while (nextTypeIndex >= 0)
+		ECS_TRACE(CloneEntity, newEntity, entity, 0, signature);
+		for (int typeIndex : signature.require.bits())
 		{
-			ComponentType nextType = static_cast<ComponentType>(nextTypeIndex);
-
-			signature.require.set(nextTypeIndex, false);
-			nextTypeIndex = signature.require.lowest();
-
-			if (nextType == GetComponentType<Prefab>())
+			ComponentType nextType = static_cast<ComponentType>(typeIndex);
+			if (nextType == GetComponentType<Prefab>() || nextType == GetComponentType<Disabled>() || nextType == GetComponentType<Pooled>())
 				continue;
 
-			const char* nextTypeName = componentManager.GetComponentTypeName(nextType);
-			ecs::Log("    Add Component<{}>", nextTypeName);
-
-			if (auto [ptr, size] = componentManager.TryGetComponent(entity, nextType); ptr)
-				AddComponentUntypedNoNotify(newEntity, newSignature, nextType, ptr, size);
+			ECS_TRACE(AddComponent, newEntity, 0, nextType);
+			componentManager.CloneComponent(entity, newEntity, nextType);
+			newSignature.require.set(nextType, true);
+			entityManager.SetSignature(newEntity, newSignature);
 		}
 		queryManager.OnEntitySignatureChanged(newEntity, newSignature, {});
 
 		return newEntity;
 	}
 
+	// Moves every entity of staging into this world, leaving staging empty.
+	// Staging worlds are populated away from the main thread and must register the same components in the same order as this world.
+	// Entities are created and their components moved in with one remap pass, then every query is updated once for the whole batch.
+	// Pooled components and entity pools are remapped, any other entity stored inside a component must be remapped by the caller.
+	EntityRemap MergeFrom(World& staging)
+	{
+		ASSERT(componentManager.HasSameComponentTypes(staging.componentManager) && "Staging world component registration differs.");
+		ASSERT(staging.deferredDestroyEntities.empty() && staging.deferredReleaseEntities.empty() && "Staging world has deferred changes.");
+
+		std::vector<Entity> stagingEntities(staging.entityManager.GetActiveEntities().begin(), staging.entityManager.GetActiveEntities().end());
+		std::vector<Entity> mergedEntities;
+		mergedEntities.reserve(stagingEntities.size());
+		EntityRemap remap;
+		remap.reserve(stagingEntities.size());
+
+		for (Entity stagingEntity : stagingEntities)
+		{
+			Entity entity = entityManager.CreateEntity(staging.entityManager.GetEntityCategory(stagingEntity));
+			entityManager.SetSignature(entity, staging.entityManager.GetSignature(stagingEntity));
+			remap.emplace(stagingEntity, entity);
+			mergedEntities.emplace_back(entity);
+		}
+
+		componentManager.MoveComponentsFrom(staging.componentManager, remap);
+
+		ComponentType pooledType = GetComponentType<Pooled>();
+		for (Entity entity : mergedEntities)
+		{
+			if (entityManager.GetSignature(entity).require.test(pooledType))
+				GetComponent<Pooled>(entity).prefab = remap.at(GetComponent<Pooled>(entity).prefab);
+		}
+
+		for (const auto& [prefab, pool] : staging.entityPools)
+		{
+			std::vector<Entity>& mergedPool = entityPools[remap.at(prefab)];
+			for (Entity entity : pool)
+				mergedPool.emplace_back(remap.at(entity));
+		}
+
+		queryManager.OnEntitiesAdded(mergedEntities, entityManager);
+		staging.DestroyEntities(stagingEntities);
+		staging.entityPools.clear();
+
+		return remap;
+	}
+
 	void DestroyEntity(Entity entity)
 	{
-		ecs::Log("[World] DestroyEntity {}", entity);
+		DestroyEntities(std::span(&entity, 1));
+	}
+
+	// Entities are removed from all queries before any component storage changes and component references are refreshed once for the whole batch.
+	// Entities must be active and unique.
+	void DestroyEntities(std::span<const Entity> entities)
+	{
+		if (entities.empty())
+			return;
+
+		ComponentType pooledType = GetComponentType<Pooled>();
+		for (Entity entity : entities)
+		{
+			ASSERT(entityManager.IsActive(entity) && "Destroying inactive entity.");
+
+			// Dormant pooled entities must also leave their pool
+			if (entityManager.GetSignature(entity).require.test(pooledType) && !IsEnabled(entity))
+				std::erase(entityPools[GetComponent<Pooled>(entity).prefab], entity);
+		}
 
 		queryManager.BeginComponentRefUpdates();
-		queryManager.OnEntitySignatureChanged(entity, Signature{}, entityManager.GetSignature(entity));
-		componentManager.OnEntityDestroyed(entity);
-		entityManager.DestroyEntity(entity);
+		queryManager.OnEntitiesDestroyed(entities, entityManager);
+		for (Entity entity : entities)
+		{
+			componentManager.OnEntityDestroyed(entity, entityManager.GetSignature(entity));
+			entityManager.DestroyEntity(entity);
+		}
 		queryManager.ApplyComponentRefUpdates();
 	}
 
+	// Destruction is deferred until the next sync point (ApplyDeferred) so query entity lists stay stable while systems iterate them
+	void DeferDestroyEntity(Entity entity)
+	{
+		deferredDestroyEntities.emplace_back(entity);
+	}
+
+	void DeferRelease(Entity entity)
+	{
+		deferredReleaseEntities.emplace_back(entity);
+	}
+
+	void ApplyDeferred()
+	{
+		for (Entity entity : deferredReleaseEntities)
+		{
+			if (entityManager.IsActive(entity))
+				Release(entity);
+		}
+		deferredReleaseEntities.clear();
+
+		// the same entity may have been deferred more than once
+		std::ranges::sort(deferredDestroyEntities);
+		auto [first, last] = std::ranges::unique(deferredDestroyEntities);
+		deferredDestroyEntities.erase(first, last);
+		std::erase_if(deferredDestroyEntities, [this](Entity entity) { return !entityManager.IsActive(entity); });
+
+		DestroyEntities(deferredDestroyEntities);
+		deferredDestroyEntities.clear();
+	}
+
+	// Toggles the Disabled signature bit. Component storage is left untouched, only query membership changes.
+	void SetEnabled(Entity entity, bool enabled)
+	{
+		Signature signature = entityManager.GetSignature(entity);
+		Signature oldSignature = signature;
+		signature.require.set(GetComponentType<Disabled>(), !enabled);
+		entityManager.SetSignature(entity, signature);
+
+		queryManager.OnEntitySignatureChanged(entity, signature, oldSignature);
+	}
+
+	bool IsEnabled(Entity entity) const
+	{
+		return !entityManager.GetSignature(entity).require.test(GetComponentType<Disabled>());
+	}
+
+	// Returns an enabled instance of prefab.
+	// Dormant instances previously released to the prefab's pool are reused by copying the prefab's component values over them
+	// which avoids any component storage changes, a new instance is only cloned when the pool is empty.
+	Entity Acquire(Entity prefab)
+	{
+		if (std::vector<Entity>& pool = entityPools[prefab]; !pool.empty())
+		{
+			Entity entity = pool.back();
+			pool.pop_back();
+
+			CopyComponentValues(prefab, entity);
+			SetEnabled(entity, true);
+			return entity;
+		}
+
+		Entity entity = CloneEntity(prefab);
+		AddComponent(entity, Pooled{ prefab });
+		return entity;
+	}
+
+	// Disables an entity created with Acquire and returns it to its prefab's pool
+	void Release(Entity entity)
+	{
+		ASSERT(HasComponent<Pooled>(entity) && "Entity was not acquired from a pool.");
+
+		if (!IsEnabled(entity))
+			return;
+
+		SetEnabled(entity, false);
+		entityPools[GetComponent<Pooled>(entity).prefab].emplace_back(entity);
+	}
+
 	template <typename T>
 	void RegisterComponent()
 	{
@@ -928,12 +1983,43 @@ public:
 		RegisterComponentsHelper<Components...>();
 	}
 
+	template <typename... Events>
+	void RegisterEvents()
+	{
+		(eventManager.RegisterEvent<Events>(), ...);
+	}
+
+	template <typename T>
+	EventChannel<T>& Events()
+	{
+		return eventManager.GetChannel<T>();
+	}
+
+	// Makes the events sent since the last swap readable, called by the schedule at the start of every fixed tick
+	void SwapEvents()
+	{
+		eventManager.SwapAll();
+	}
+
+	// Cleared by the schedule while stages outside the fixed tick run, reading events then asserts
+	void SetEventsReadable(bool readable)
+	{
+		eventManager.SetAllReadable(readable);
+	}
+
 	template <typename T>
-	T& AddComponent(Entity entity, const T& component)
+	component_reference_t<T> AddComponent(Entity entity, const T& component)
+	{
+		return EmplaceComponent<T>(entity, component);
+	}
+
+	// Constructs the component in place from args, e.g. EmplaceComponent<Path>(entity, std::move(points))
+	template <typename T, typename... Args>
+	component_reference_t<T> EmplaceComponent(Entity entity, Args&&... args)
 	{
 		Signature signature = entityManager.GetSignature(entity);
 		Signature oldSignature = signature;
-		T& result = AddComponentNoNotify(entity, signature, component);
+		component_reference_t<T> result = EmplaceComponentNoNotify<T>(entity, signature, std::forward<Args>(args)...);
 
 		queryManager.OnEntitySignatureChanged(entity, signature, oldSignature);
 
@@ -959,7 +2045,7 @@ public:
 	}
 
 	template <typename... Components>
-	std::tuple<Components&...> AddComponents(Entity entity, Components... components)
+	std::tuple<component_reference_t<Components>...> AddComponents(Entity entity, Components... components)
 	{
 		Signature signature = entityManager.GetSignature(entity);
 		Signature oldSignature = signature;
@@ -974,6 +2060,8 @@ public:
 	template <typename T>
 	void RemoveComponent(Entity entity)
 	{
+		ECS_TRACE(RemoveComponent, entity, 0, componentManager.GetComponentType<T>());
+		queryManager.BeginComponentRefUpdates();
 		componentManager.RemoveComponent<T>(entity);
 
 		Signature signature = entityManager.GetSignature(entity);
@@ -981,7 +2069,6 @@ public:
 		signature.require.set(componentManager.GetComponentType<T>(), false);
 		entityManager.SetSignature(entity, signature);
 
-		queryManager.BeginComponentRefUpdates();
 		queryManager.OnEntitySignatureChanged(entity, signature, oldSignature);
 		queryManager.ApplyComponentRefUpdates();
 	}
@@ -993,21 +2080,50 @@ public:
 	}
 
 	template <typename T>
-	T& GetComponent(Entity entity)
+	component_reference_t<T> GetComponent(Entity entity)
 	{
 		return componentManager.GetComponent<T>(entity);
 	}
 
+	// Contiguous view of one field of every stored component with a soa_layout, e.g. GetComponentFieldSpan<&Transform::position>()
+	// Elements are in component storage order, soa_component_ref::index - 1 for a query entity.
+	template <auto Member>
+	auto GetComponentFieldSpan()
+	{
+		using T = typename member_pointer_traits<decltype(Member)>::class_type;
+		constexpr size_t field = soa_field_index<T, Member>();
+		static_assert(field < std::tuple_size_v<std::decay_t<decltype(soa_layout<T>::fields)>>, "Member is not a field of the component's soa_layout.");
+		return componentManager.GetComponentFieldSpan<T, field>();
+	}
+
 	template <typename T>
 	std::optional<std::reference_wrapper<T>> GetOptionalComponent(Entity entity)
 	{
+		static_assert(!is_soa_component_v<T>, "Optional access is not supported for soa_layout components.");
 		if (HasComponent<T>(entity))
 			return componentManager.GetComponent<T>(entity);
 		return {};
 	}
 
 	template <typename T>
-	T& GetOrAddComponent(Entity entity, const T& component)
+	T* TryGetComponent(Entity entity)
+	{
+		static_assert(!is_soa_component_v<T>, "Optional access is not supported for soa_layout components.");
+		if (HasComponent<T>(entity))
+			return &componentManager.GetComponent<T>(entity);
+		return nullptr;
+	}
+
+	// Points the entity's Shared<T> component at the shared value equal to value
+	template <typename T>
+	void SetShared(Entity entity, const T& value)
+	{
+		Shared<T>& shared = GetComponent<Shared<T>>(entity);
+		shared.value = SharedComponentStore<T>::Get().Exchange(shared.value, value);
+	}
+
+	template <typename T>
+	component_reference_t<T> GetOrAddComponent(Entity entity, const T& component)
 	{
 		if (HasComponent<T>(entity))
 			return GetComponent<T>(entity);
@@ -1020,6 +2136,13 @@ public:
 		return GetComponentsHelper<Components...>(entity);
 	}
 
+	// Entries for each of the query list types of Components, see component_list_t
+	template <typename... Components>
+	auto GetQueryListEntries(Entity entity)
+	{
+		return std::tuple_cat(GetQueryListEntryHelper<Components>(entity)...);
+	}
+
 	template <typename T>
 	ComponentType GetComponentType() const
 	{
@@ -1088,6 +2211,22 @@ public:
 		return componentManager.BuildSignature<Components...>();
 	}
 
+	// Gives query ownership of the storage order of its required components.
+	// ReorderStorage then incrementally swaps them into query order so the query iterates its component arrays front to back,
+	// and once IsStorageOrdered its soa_layout fields can be read as contiguous spans with Query::GetOwnedFieldSpan.
+	void OwnStorage(QueryBase* query)
+	{
+		queryManager.OwnStorage(query->queryId);
+	}
+
+	// Spends up to budget co-sorting the storage of owning queries, call once per frame at a sync point
+	void ReorderStorage(std::chrono::microseconds budget)
+	{
+		queryManager.BeginComponentRefUpdates();
+		queryManager.ReorderOwnedStorage(componentManager, std::chrono::steady_clock::now() + budget);
+		queryManager.ApplyComponentRefUpdates();
+	}
+
 	Entity GetEntityCount() const { return entityManager.GetEntityCount(); }
 
 private:
@@ -1102,19 +2241,19 @@ private:
 	template <typename T>
 	auto AddComponentHelper(Entity entity, const T& component)
 	{
-		return std::tuple<T&>(AddComponent(entity, component));
+		return std::tuple<component_reference_t<T>>(AddComponent(entity, component));
 	}
 
 	template <typename Head, typename... Tail>
-	std::tuple<Head&, Tail&...> AddComponentsHelper(Entity entity, Signature& signature, const Head& head, const Tail&... tail)
+	std::tuple<component_reference_t<Head>, component_reference_t<Tail>...> AddComponentsHelper(Entity entity, Signature& signature, Head& head, Tail&... tail)
 	{
 		if constexpr (sizeof...(tail) > 0)
 		{
-			auto first = std::tuple<Head&>(AddComponentNoNotify(entity, signature, head));
+			auto first = std::tuple<component_reference_t<Head>>(EmplaceComponentNoNotify<Head>(entity, signature, std::move(head)));
 			return std::tuple_cat(first, AddComponentsHelper(entity, signature, tail...));
 		}
 		else
-			return std::tuple<Head&>(AddComponentNoNotify(entity, signature, head));
+			return std::tuple<component_reference_t<Head>>(EmplaceComponentNoNotify<Head>(entity, signature, std::move(head)));
 	}
 
 	template <typename T>
@@ -1122,8 +2261,23 @@ private:
 	{
 		if constexpr (is_reject_component_v<T>)
 			return std::tuple<>();
+		else if constexpr (is_optional_component_v<T>)
+			return std::tuple<typename T::Component*>(TryGetComponent<typename T::Component>(entity));
+		else
+			return std::tuple<component_reference_t<T>>(GetComponent<T>(entity));
+	}
+
+	template <typename T>
+	auto GetQueryListEntryHelper(Entity entity)
+	{
+		if constexpr (is_reject_component_v<T>)
+			return std::tuple<>();
+		else if constexpr (is_optional_component_v<T>)
+			return std::tuple<typename T::Component*>(TryGetComponent<typename T::Component>(entity));
+		else if constexpr (is_soa_component_v<T>)
+			return std::tuple<soa_component_ref<T>>(componentManager.GetSoAComponentRef<T>(entity));
 		else
-			return std::tuple<T&>(GetComponent<T>(entity));
+			return std::tuple<std::reference_wrapper<T>>(GetComponent<T>(entity));
 	}
 
 	template <typename Head, typename... Tail>
@@ -1135,22 +2289,32 @@ private:
 			return GetFirstHelper<Head>(entity);
 	}
 
-	template <typename T>
-	T& AddComponentNoNotify(Entity entity, Signature& signature, const T& component)
+	template <typename T, typename... Args>
+	component_reference_t<T> EmplaceComponentNoNotify(Entity entity, Signature& signature, Args&&... args)
 	{
-		ecs::Log("AddComponent<{}> to Entity {}", typeid(T).name() + 7, entity);
+		ComponentType componentType = componentManager.GetComponentType<T>();
+		ECS_TRACE(AddComponent, entity, 0, componentType);
 
-		T& result = componentManager.AddComponent<T>(entity, component);
+		component_reference_t<T> result = componentManager.EmplaceComponent<T>(entity, std::forward<Args>(args)...);
 
-		signature.require.set(componentManager.GetComponentType<T>(), true);
+		signature.require.set(componentType, true);
 		entityManager.SetSignature(entity, signature);
 
 		return result;
 	}
 
+	// Overwrites the values of every component of source that destination also has, without changing either signature
+	void CopyComponentValues(Entity source, Entity destination)
+	{
+		for (int typeIndex : entityManager.GetSignature(source).require.bits())
+		{
+			componentManager.CopyComponent(source, destination, static_cast<ComponentType>(typeIndex));
+		}
+	}
+
 	void* AddComponentUntypedNoNotify(Entity entity, Signature& signature, ComponentType componentType, const void* source, size_t size)
 	{
-		ecs::Log("AddComponent<{}> to Entity {}", GetComponentTypeName(componentType), entity);
+		ECS_TRACE(AddComponent, entity, 0, componentType);
 
 		void* result = componentManager.AddComponentUntyped(entity, componentType, source, size);
 
@@ -1165,23 +2329,71 @@ private:
 	ComponentManager componentManager;
 	SystemManager systemManager;
 	QueryManager queryManager;
+	EventManager eventManager;
+	std::vector<Entity> deferredDestroyEntities;
+	std::vector<Entity> deferredReleaseEntities;
+	std::unordered_map<Entity, std::vector<Entity>> entityPools;
 };
 
 inline void LogSignature(const World& world, Signature signature)
 {
-	ecs::Log(" Require: {}", world.BuildSignatureLayerString(signature.require));
+	ECS_LOG(" Require: {}", world.BuildSignatureLayerString(signature.require));
 	if (!signature.reject.empty())
-		ecs::Log(" Reject:  {}", world.BuildSignatureLayerString(signature.reject));
+		ECS_LOG(" Reject:  {}", world.BuildSignatureLayerString(signature.reject));
 }
 
 inline void LogCompareSignatures(const World& world, const char* label1, Signature signature1, const char* label2, Signature signature2)
 {
-	ecs::Log("Compare 1: {} {} -> 2: {} {}", label1, signature1, label2, signature2);
-	ecs::Log(" Require 1: {}", world.BuildSignatureLayerString(signature1.require));
-	ecs::Log(" Reject  1: {}", world.BuildSignatureLayerString(signature1.reject));
-	ecs::Log(" Require 2: {}", world.BuildSignatureLayerString(signature2.require));
-	ecs::Log(" Reject  2: {}", world.BuildSignatureLayerString(signature2.reject));
+	ECS_LOG("Compare 1: {} {} -> 2: {} {}", label1, signature1, label2, signature2);
+	ECS_LOG(" Require 1: {}", world.BuildSignatureLayerString(signature1.require));
+	ECS_LOG(" Reject  1: {}", world.BuildSignatureLayerString(signature1.reject));
+	ECS_LOG(" Require 2: {}", world.BuildSignatureLayerString(signature2.require));
+	ECS_LOG(" Reject  2: {}", world.BuildSignatureLayerString(signature2.reject));
+}
+
+#if ENABLE_ECS_TRACE
+// Formats every event in the trace buffer from oldest to newest, this is the only place trace events are turned into strings
+inline void ecs::trace::Dump(const World& world)
+{
+	Buffer& buffer = GetBuffer();
+
+	for (int i = 0; i < buffer.events.ssize(); ++i)
+	{
+		const Event& event = buffer.events[buffer.events.next_index(buffer.events.index(), i)];
+		if (event.sequence == 0)
+			continue;
+
+		switch (event.type)
+		{
+		case EventType::CreateEntity:
+			debug::Log("[{}] CreateEntity {}", event.sequence, event.entity);
+			break;
+		case EventType::DestroyEntity:
+			debug::Log("[{}] DestroyEntity {}", event.sequence, event.entity);
+			break;
+		case EventType::CloneEntity:
+			debug::Log("[{}] CloneEntity {} -> {} Require: {}", event.sequence, event.arg, event.entity, world.BuildSignatureLayerString(event.signature.require));
+			break;
+		case EventType::AddComponent:
+			debug::Log("[{}] AddComponent<{}> to Entity {}", event.sequence, world.GetComponentTypeName(event.componentType), event.entity);
+			break;
+		case EventType::RemoveComponent:
+			debug::Log("[{}] RemoveComponent<{}> from Entity {}", event.sequence, world.GetComponentTypeName(event.componentType), event.entity);
+			break;
+		case EventType::CreateQuery:
+			debug::Log("[{}] CreateQuery {} Require: {} Reject: {}", event.sequence, event.arg,
+				world.BuildSignatureLayerString(event.signature.require), world.BuildSignatureLayerString(event.signature.reject));
+			break;
+		case EventType::QueryMatch:
+			debug::Log("[{}] Query {} Add Entity {}", event.sequence, event.arg, event.entity);
+			break;
+		case EventType::QueryUnmatch:
+			debug::Log("[{}] Query {} Remove Entity {}", event.sequence, event.arg, event.entity);
+			break;
+		}
+	}
 }
+#endif
 
 template <typename T, typename ... Components>
 auto System<T, Components...>::Register(World& world, SystemFlags systemFlags)
@@ -1195,12 +2407,26 @@ auto System<T, Components...>::GetArchetype(Entity entity) const
 	return GetWorld().template GetComponents<Components...>(entity);
 }
 
+template <typename T, typename ... Components>
+auto System<T, Components...>::GetArchetypeAtIndex(QueryBase::Index index)
+{
+	return GetSystemQuery()->GetArchetypeAtIndex(index);
+}
+
 template <typename T, typename ... Components>
 const std::vector<Entity>& System<T, Components...>::GetEntities()
 {
 	return GetSystemQuery()->GetEntities();
 }
 
+template <typename T, typename ... Components>
+std::pair<QueryBase::Index, QueryBase::Index> System<T, Components...>::GetSliceRange()
+{
+	QueryBase::Index count = std::ssize(GetEntities());
+	SystemSlice slice = GetSlice();
+	return { count * slice.index / slice.count, count * (slice.index + 1) / slice.count };
+}
+
 template <typename T, typename ... Components>
 auto System<T, Components...>::GetSystemQuery()
 {
@@ -1237,7 +2463,7 @@ void Query<Components...>::InsertLists(Index index, Entity entity)
 	if constexpr (component_reject_filter_size_v<Components...> > 0)
 	{
 		auto sequence = std::make_index_sequence<component_reject_filter_size_v<Components...>>();
-		auto comps = GetArchetype(entity);
+		auto comps = GetWorld().template GetQueryListEntries<Components...>(entity);
 		tuple_vector_apply([&](auto idx, auto& idxVec) { idxVec.insert(idxVec.begin() + index, std::get<idx>(comps)); }, componentLists, sequence);
 	}
 }
@@ -1249,6 +2475,47 @@ void Query<Components...>::RemoveLists(Index index)
 	tuple_vector_apply([&](auto idx, auto& idxVec) { idxVec.erase(idxVec.begin() + index); }, componentLists, sequence);
 }
 
+template <typename... Components>
+void Query<Components...>::MoveLists(Index from, Index to)
+{
+	auto sequence = std::make_index_sequence<component_reject_filter_size_v<Components...>>();
+	tuple_vector_apply([&](auto idx, auto& idxVec) { idxVec[to] = idxVec[from]; }, componentLists, sequence);
+}
+
+template <typename... Components>
+void Query<Components...>::TruncateLists(Index size)
+{
+	auto sequence = std::make_index_sequence<component_reject_filter_size_v<Components...>>();
+	tuple_vector_apply([&](auto idx, auto& idxVec) { idxVec.erase(idxVec.begin() + size, idxVec.end()); }, componentLists, sequence);
+}
+
+// Rebuilds the lists for the merged entity list, entries of entities in previousEntities are kept and the rest are looked up
+template <typename... Components>
+void Query<Components...>::MergeLists(const std::vector<Entity>& previousEntities)
+{
+	if constexpr (component_reject_filter_size_v<Components...> > 0)
+	{
+		auto sequence = std::make_index_sequence<component_reject_filter_size_v<Components...>>();
+		auto previousLists = std::move(componentLists);
+		tuple_vector_apply([&](auto idx, auto& idxVec) { idxVec.clear(); idxVec.reserve(entities.size()); }, componentLists, sequence);
+
+		Index previousIndex = 0;
+		for (Entity entity : entities)
+		{
+			if (previousIndex < std::ssize(previousEntities) && previousEntities[previousIndex] == entity)
+			{
+				tuple_vector_apply([&](auto idx, auto& idxVec) { idxVec.emplace_back(std::get<idx>(previousLists)[previousIndex]); }, componentLists, sequence);
+				++previousIndex;
+			}
+			else
+			{
+				auto comps = GetWorld().template GetQueryListEntries<Components...>(entity);
+				tuple_vector_apply([&](auto idx, auto& idxVec) { idxVec.emplace_back(std::get<idx>(comps)); }, componentLists, sequence);
+			}
+		}
+	}
+}
+
 template <typename ... Components>
 void Query<Components...>::RefreshComponentReferences()
 {
@@ -1257,24 +2524,49 @@ void Query<Components...>::RefreshComponentReferences()
 	int index = 0;
 	for (auto entity : entities)
 	{
-		auto components = GetArchetype(entity);
+		auto components = GetWorld().template GetQueryListEntries<Components...>(entity);
 		tuple_vector_apply([&](auto idx, auto& idxVec) { idxVec[index] = std::get<idx>(components); }, componentLists, sequence);
 		index++;
 	}
 }
 
+template <typename ... Components>
+template <auto Member>
+auto Query<Components...>::GetOwnedFieldSpan() const
+{
+	using T = typename member_pointer_traits<decltype(Member)>::class_type;
+	static_assert(std::disjunction_v<std::is_same<T, Components>...>, "Component is not a required term of the query.");
+	ASSERT(IsStorageOrdered() && "Query storage is not ordered.");
+	return GetWorld().template GetComponentFieldSpan<Member>().first(entities.size());
+}
+
+template <typename ... Components>
+void Query<Components...>::RefreshEntity(Entity entity)
+{
+	auto sequence = std::make_index_sequence<component_reject_filter_size_v<Components...>>();
+
+	Index index = FindEntityIndex(entity);
+	ASSERT(index < std::ssize(entities) && entities[index] == entity && "Entity did not exist in query.");
+
+	auto components = GetWorld().template GetQueryListEntries<Components...>(entity);
+	tuple_vector_apply([&](auto idx, auto& idxVec) { idxVec[index] = std::get<idx>(components); }, componentLists, sequence);
+}
+
 template <class... Components>
 Query<Components...>* QueryManager::CreateQuery(QueryCallbacks callbacks)
 {
 	Signature signature = world.BuildSignature<Components...>();
 
+	// Disabled entities are invisible to queries unless they ask for them
+	if (ComponentType disabledType = world.GetComponentType<Disabled>(); !signature.require.test(disabledType))
+		signature.reject.set(disabledType, true);
+
 	signatures.insert(signature);
 
 	QueryId queryId = nextQueryId++;
 	queriesBySignature[signature].emplace_back(queryId);
 
-	ecs::Log("Create Query {}", queryId);
-	LogSignature(world, signature);
+	ECS_TRACE(CreateQuery, kInvalidEntity, queryId, 0, signature);
 	queries[queryId] = std::make_unique<Query<Components...>>(queryId, &world, signature, callbacks);
 	QueryBase* baseQuery = queries[queryId].get();
 	return static_cast<Query<Components...>*>(baseQuery);
@@ -1301,7 +2593,7 @@ inline void QueryManager::OnEntitySignatureChanged(Entity entity, Signature newS
 	if (newSignature == oldSignature)
 		return;
 
-	ecs::Log("[QueryManager] OnEntitySignatureChanged {}", entity);
+	ECS_LOG("[QueryManager] OnEntitySignatureChanged {}", entity);
 
 	for (const Signature& signature : signatures)
 	{
@@ -1312,9 +2604,6 @@ inline void QueryManager::OnEntitySignatureChanged(Entity entity, Signature newS
 				// Entity did not match query but now does, add it to the query entity list
 				QueryBase* query = GetQueryUntypedById(queryId);
 
-				//ecs::Log("Query {} match Entity {}", queryId, entity);
-				//LogCompareSignatures(world, "Match Query", signature, "Entity", newSignature);
-
 #ifdef _DEBUG
 				auto search = std::ranges::find(query->GetEntities(), entity);
 				ASSERT(search == query->GetEntities().end() && "Entity already exists in query.");
@@ -1330,9 +2619,6 @@ inline void QueryManager::OnEntitySignatureChanged(Entity entity, Signature newS
 				// Entity no longer matches query but used to so remove it from the query entity list
 				QueryBase* query = GetQueryUntypedById(queryId);
 
-				//ecs::Log("Query {} unmatch Entity {}", queryId, entity);
-				//LogCompareSignatures(world, "Unmatch Query", signature, "Entity", newSignature);
-
 #ifdef _DEBUG
 				auto search = std::ranges::find(query->GetEntities(), entity);
 				ASSERT(search != query->GetEntities().end() && "Entity did not exist in query.");
@@ -1345,6 +2631,119 @@ inline void QueryManager::OnEntitySignatureChanged(Entity entity, Signature newS
 			}
 
 		}
+		else if (!signature.optional.empty() && signature.Matches(newSignature) &&
+			!((newSignature.require ^ oldSignature.require) & signature.optional).empty())
+		{
+			// Entity still matches but gained or lost one of the query's optional components, only its cached pointers need updating
+			for (QueryId queryId : queriesBySignature[signature])
+			{
+				GetQueryUntypedById(queryId)->RefreshEntity(entity);
+			}
+		}
+	}
+
+	// Removed components leave a hole in their component array that is filled by swapping in the last element,
+	// which invalidates references held by any query for the entity that was moved, even queries the changed entity was never part of.
+	if (areComponentRefsUpdating)
+		pendingMovedComponents |= (oldSignature.require ^ newSignature.require) & oldSignature.require;
+}
+
+// Batched equivalent of calling OnEntitySignatureChanged with an empty signature for each entity,
+// every query is compacted once no matter how many of its entities are destroyed.
+inline void QueryManager::OnEntitiesDestroyed(std::span<const Entity> entities, const EntityManager& entityManager)
+{
+	ASSERT(areComponentRefsUpdating && "Destroying entities must be surrounded by Begin/ApplyComponentRefUpdates.");
+
+	std::vector<Entity> matchingEntities;
+	matchingEntities.reserve(entities.size());
+
+	for (const Signature& signature : signatures)
+	{
+		matchingEntities.clear();
+		for (Entity entity : entities)
+		{
+			if (signature.Matches(entityManager.GetSignature(entity)))
+				matchingEntities.emplace_back(entity);
+		}
+
+		if (matchingEntities.empty())
+			continue;
+
+		std::ranges::sort(matchingEntities);
+		for (QueryId queryId : queriesBySignature[signature])
+		{
+			GetQueryUntypedById(queryId)->RemoveEntities(matchingEntities);
+			pendingRefUpdateQueries.insert(queryId);
+		}
+	}
+
+	for (Entity entity : entities)
+		pendingMovedComponents |= entityManager.GetSignature(entity).require;
+}
+
+// Batched equivalent of calling OnEntitySignatureChanged from an empty signature for each entity
+inline void QueryManager::OnEntitiesAdded(std::span<const Entity> entities, const EntityManager& entityManager)
+{
+	std::vector<Entity> matchingEntities;
+	matchingEntities.reserve(entities.size());
+
+	for (const Signature& signature : signatures)
+	{
+		matchingEntities.clear();
+		for (Entity entity : entities)
+		{
+			if (signature.Matches(entityManager.GetSignature(entity)))
+				matchingEntities.emplace_back(entity);
+		}
+
+		if (matchingEntities.empty())
+			continue;
+
+		std::ranges::sort(matchingEntities);
+		for (QueryId queryId : queriesBySignature[signature])
+			GetQueryUntypedById(queryId)->AddEntities(matchingEntities);
+	}
+}
+
+// A component type's storage order can only be owned by one query
+inline void QueryManager::OwnStorage(QueryId queryId)
+{
+	QueryBase* query = GetQueryUntypedById(queryId);
+	ASSERT(query && "Query does not exist.");
+	ASSERT(!query->ownsStorage && "Query already owns its storage.");
+	ASSERT((ownedComponents & query->GetSignature().require).empty() && "Component storage is already owned by another query.");
+
+	ownedComponents |= query->GetSignature().require;
+	owningQueries.emplace_back(queryId);
+	query->ownsStorage = true;
+	query->orderedCount = 0;
+}
+
+// Resumes co-sorting every owning query from its first unordered entity until all are ordered or the deadline passes.
+// Must be surrounded by Begin/ApplyComponentRefUpdates, swapped components invalidate the references of every query using them.
+inline void QueryManager::ReorderOwnedStorage(ComponentManager& componentManager, std::chrono::steady_clock::time_point deadline)
+{
+	ASSERT(areComponentRefsUpdating && "Reordering storage must be surrounded by Begin/ApplyComponentRefUpdates.");
+
+	// Reading the clock costs more than a few swaps
+	constexpr QueryBase::Index kDeadlineCheckInterval = 64;
+
+	for (QueryId queryId : owningQueries)
+	{
+		QueryBase* query = GetQueryUntypedById(queryId);
+		Signature::Layer owned = query->GetSignature().require;
+
+		while (query->orderedCount < std::ssize(query->entities))
+		{
+			// Every entity before orderedCount already sits at its own index so the target slot is held by an unordered entity
+			Entity entity = query->entities[query->orderedCount];
+			if (componentManager.MoveComponentsToIndex(entity, owned, query->orderedCount + 1))
+				pendingMovedComponents |= owned;
+
+			++query->orderedCount;
+			if (query->orderedCount % kDeadlineCheckInterval == 0 && std::chrono::steady_clock::now() >= deadline)
+				return;
+		}
 	}
 }
 
@@ -1366,9 +2765,22 @@ inline void QueryManager::ApplyComponentRefUpdates()
 	// properly update the references on the query.
 	// Because a Reject<T> component would potentially remove an entity from a query without the underlying references being changed it's still necessary to allow
 	// entity removal from queries during signature changes that are purely additive like in AddComponent but not require that entity references get updated since nothing would change.
+	if (!pendingMovedComponents.empty())
+	{
+		for (const auto& [queryId, query] : queries)
+		{
+			const Signature& signature = query->GetSignature();
+			if (!((signature.require | signature.optional) & pendingMovedComponents).empty())
+				pendingRefUpdateQueries.insert(queryId);
+		}
+	}
+
 	for (QueryId queryId : pendingRefUpdateQueries)
 	{
 		QueryBase* query = GetQueryUntypedById(queryId);
 		query->RefreshComponentReferences();
 	}
+
+	pendingRefUpdateQueries.clear();
+	pendingMovedComponents.reset();
 }
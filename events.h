@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <span>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+
+// Typed event channels for gameplay signals that would otherwise be encoded as component adds/removes.
+// Every event type gets its own pair of contiguous arrays. Events sent during a fixed tick are appended to the write array
+// and become readable in bulk from the other array for the whole of the next tick, after SwapEvents at the start of the tick (see Schedule::Run).
+// A reader in a fixed stage sees every event exactly once. Stages outside the fixed tick run once per frame, they would read the same events again
+// on frames without a tick and miss some on frames with several, so the schedule marks events unreadable while they run and Read asserts.
+// Channels never drop events, a tick that sends more than fit is kept in an overflow list and the arrays grow to fit it on the next swap.
+
+constexpr int kInitialEventCapacity = 1024;
+
+class IEventChannel
+{
+public:
+	virtual ~IEventChannel() = default;
+	virtual void Swap() = 0;
+	virtual void SetReadable(bool readable) = 0;
+};
+
+template <typename T>
+class EventChannel final : public IEventChannel
+{
+public:
+	EventChannel()
+	{
+		buffers[writeBuffer].resize(capacity);
+	}
+
+	// Safe to call from any thread, slots in the write array are claimed with an atomic increment.
+	// Once the array is full events go to the overflow list under a lock until the next swap grows the array.
+	void Send(const T& event)
+	{
+		int index = writeCount.fetch_add(1, std::memory_order_relaxed);
+		if (index < capacity)
+		{
+			buffers[writeBuffer][index] = event;
+		}
+		else
+		{
+			std::scoped_lock lock(overflowMutex);
+			overflow.emplace_back(event);
+		}
+	}
+
+	// Events sent during the previous fixed tick
+	std::span<const T> Read() const
+	{
+		ASSERT(isReadable && "Events are only read reliably from the fixed stages.");
+		return std::span<const T>(buffers[writeBuffer ^ 1].data(), readCount);
+	}
+
+	bool Empty() const { return readCount == 0; }
+
+	void SetReadable(bool readable) override { isReadable = readable; }
+
+	// Must only be called while no thread is sending
+	void Swap() override
+	{
+		std::vector<T>& written = buffers[writeBuffer];
+		readCount = std::min(writeCount.exchange(0), capacity);
+
+		if (!overflow.empty())
+		{
+			written.resize(readCount);
+			written.insert(written.end(), overflow.begin(), overflow.end());
+			readCount = static_cast<int>(written.size());
+			overflow.clear();
+			capacity = static_cast<int>(std::bit_ceil(static_cast<unsigned>(readCount)));
+		}
+
+		writeBuffer ^= 1;
+		if (static_cast<int>(buffers[writeBuffer].size()) < capacity)
+			buffers[writeBuffer].resize(capacity);
+	}
+
+private:
+	std::array<std::vector<T>, 2> buffers;
+	std::atomic<int> writeCount{};
+	int capacity = kInitialEventCapacity;
+	int writeBuffer = 0;
+	int readCount = 0;
+	bool isReadable = true;
+
+	std::mutex overflowMutex;
+	std::vector<T> overflow;
+};
+
+class EventManager
+{
+	using EventId = intptr_t;
+
+	template <typename T>
+	static constexpr EventId GetEventId()
+	{
+		return reinterpret_cast<EventId>(typeid(T).name());
+	}
+
+public:
+	template <typename T>
+	auto RegisterEvent() -> std::enable_if_t<std::is_trivially_copyable_v<T>, void>
+	{
+		EventId eventId = GetEventId<T>();
+		ASSERT(!channels.contains(eventId) && "Event already registered.");
+		channels.insert({ eventId, std::make_unique<EventChannel<T>>() });
+	}
+
+	template <typename T>
+	EventChannel<T>& GetChannel()
+	{
+		EventId eventId = GetEventId<T>();
+		ASSERT(channels.contains(eventId) && "Event not registered.");
+		return static_cast<EventChannel<T>&>(*channels.at(eventId));
+	}
+
+	void SwapAll()
+	{
+		for (const auto& channel : channels | std::views::values)
+		{
+			channel->Swap();
+		}
+	}
+
+	void SetAllReadable(bool readable)
+	{
+		for (const auto& channel : channels | std::views::values)
+		{
+			channel->SetReadable(readable);
+		}
+	}
+
+private:
+	std::unordered_map<EventId, std::unique_ptr<IEventChannel>> channels;
+};
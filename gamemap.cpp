@@ -2,6 +2,7 @@
 #include "draw.h"
 #include <algorithm>
 #include <array>
+#include <filesystem>
 #include <fstream>
 #include <rapidjson/document.h>
 #include <rapidjson/istreamwrapper.h>
@@ -17,6 +18,7 @@ namespace
 	const StrId kLayerTypeGroup("group");
 	const StrId kDrawOrderTopDown("topdown");
 	const StrId kDrawOrderIndex("index");
+	const StrId kTilePropertySolid("solid");
 
 	GameMapLayerCommon ParseLayerCommonData(const rapidjson::Document::ValueType& jsonLayer)
 	{
@@ -277,6 +279,91 @@ namespace
 		return result;
 	}
 
+	// Marks tiles with a true "solid" bool property in a tileset, tilesets are either embedded in the map or an external file next to it
+	void ParseTilesetSolidTiles(const rapidjson::Document::ValueType& jsonTileset, int firstGlobalId, std::vector<bool>& solidTiles)
+	{
+		if (!jsonTileset.HasMember("tiles"))
+			return;
+
+		ASSERT(jsonTileset["tiles"].IsArray());
+		for (const auto& jsonTile : jsonTileset["tiles"].GetArray())
+		{
+			ASSERT(jsonTile.HasMember("id"));
+			if (!jsonTile.HasMember("properties"))
+				continue;
+
+			for (const auto& jsonProperty : jsonTile["properties"].GetArray())
+			{
+				if (StrId(jsonProperty["name"].GetString()) != kTilePropertySolid || !jsonProperty["value"].IsBool() || !jsonProperty["value"].GetBool())
+					continue;
+
+				size_t globalId = static_cast<size_t>(firstGlobalId) + jsonTile["id"].GetInt();
+				if (solidTiles.size() <= globalId)
+					solidTiles.resize(globalId + 1, false);
+				solidTiles[globalId] = true;
+			}
+		}
+	}
+
+	// Indexed by tile global id
+	std::vector<bool> ParseSolidTiles(const rapidjson::Document& doc, const char* mapFileName)
+	{
+		std::vector<bool> solidTiles;
+		if (!doc.HasMember("tilesets"))
+			return solidTiles;
+
+		for (const auto& jsonTileset : doc["tilesets"].GetArray())
+		{
+			ASSERT(jsonTileset.HasMember("firstgid"));
+			int firstGlobalId = jsonTileset["firstgid"].GetInt();
+
+			if (!jsonTileset.HasMember("source"))
+			{
+				ParseTilesetSolidTiles(jsonTileset, firstGlobalId, solidTiles);
+				continue;
+			}
+
+			auto tilesetPath = std::filesystem::path(mapFileName).parent_path().append(std::string(jsonTileset["source"].GetString()));
+			std::ifstream inFileStream(tilesetPath);
+			rapidjson::IStreamWrapper streamWrapper(inFileStream);
+
+			rapidjson::Document tilesetDoc;
+			tilesetDoc.ParseStream(streamWrapper);
+			ASSERT(tilesetDoc.IsObject());
+
+			ParseTilesetSolidTiles(tilesetDoc, firstGlobalId, solidTiles);
+		}
+
+		return solidTiles;
+	}
+
+	void BuildSolidBits(GameMapLayer& layer, const std::vector<bool>& solidTiles)
+	{
+		if (GameMapGroupLayer* groupLayer = std::get_if<GameMapGroupLayer>(&layer))
+		{
+			for (GameMapLayer& subLayer : groupLayer->layers)
+				BuildSolidBits(subLayer, solidTiles);
+			return;
+		}
+
+		GameMapTileLayer* tileLayer = std::get_if<GameMapTileLayer>(&layer);
+		if (!tileLayer)
+			return;
+
+		tileLayer->solidWordsPerRow = (tileLayer->tileCountX + 63) / 64;
+		tileLayer->solidBits.assign(static_cast<size_t>(tileLayer->solidWordsPerRow) * tileLayer->tileCountY, 0);
+
+		for (int y = 0; y < tileLayer->tileCountY; ++y)
+		{
+			for (int x = 0; x < tileLayer->tileCountX; ++x)
+			{
+				size_t globalId = tileLayer->tiles[x + y * tileLayer->tileCountX].tileGlobalId;
+				if (globalId < solidTiles.size() && solidTiles[globalId])
+					tileLayer->solidBits[y * tileLayer->solidWordsPerRow + x / 64] |= uint64_t{ 1 } << (x % 64);
+			}
+		}
+	}
+
 	GameMap Load(const char* fileName)
 	{
 		std::ifstream inFileStream(fileName);
@@ -308,6 +395,10 @@ namespace
 			result.layers.push_back(layer);
 		}
 
+		std::vector<bool> solidTiles = ParseSolidTiles(doc, fileName);
+		for (GameMapLayer& layer : result.layers)
+			BuildSolidBits(layer, solidTiles);
+
 		return result;
 	}
 
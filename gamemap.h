@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
 
 #include "types.h"
@@ -33,6 +34,10 @@ struct GameMapTileLayer : public GameMapLayerCommon
 	int tileCountX{};
 	int tileCountY{};
 	std::vector<GameMapTile> tiles;
+
+	// One bit per tile, set when its tileset tile has the bool property "solid". Rows are padded to whole 64 bit words, see map::AnySolid
+	std::vector<uint64_t> solidBits;
+	int solidWordsPerRow{};
 };
 
 enum class GameMapObjectType
@@ -139,6 +144,47 @@ namespace map
 		return nullptr;
 	}
 
+	inline bool TileSolid(const GameMapTileLayer& layer, int x, int y)
+	{
+		if (x < 0 || y < 0 || x >= layer.tileCountX || y >= layer.tileCountY)
+			return false;
+
+		return (layer.solidBits[y * layer.solidWordsPerRow + x / 64] >> (x % 64)) & 1;
+	}
+
+	// Whether any tile in the inclusive tile rectangle is solid, tiles outside of the layer are not.
+	// Each row is tested a word at a time with a mask covering the columns of the rectangle.
+	inline bool AnySolid(const GameMapTileLayer& layer, int minX, int minY, int maxX, int maxY)
+	{
+		minX = std::max(minX, 0);
+		minY = std::max(minY, 0);
+		maxX = std::min(maxX, layer.tileCountX - 1);
+		maxY = std::min(maxY, layer.tileCountY - 1);
+		if (minX > maxX || minY > maxY)
+			return false;
+
+		const int firstWord = minX / 64;
+		const int lastWord = maxX / 64;
+		const uint64_t firstMask = ~uint64_t{ 0 } << (minX % 64);
+		const uint64_t lastMask = ~uint64_t{ 0 } >> (63 - maxX % 64);
+
+		for (int y = minY; y <= maxY; ++y)
+		{
+			const uint64_t* row = &layer.solidBits[y * layer.solidWordsPerRow];
+			for (int word = firstWord; word <= lastWord; ++word)
+			{
+				uint64_t mask = ~uint64_t{ 0 };
+				if (word == firstWord)
+					mask &= firstMask;
+				if (word == lastWord)
+					mask &= lastMask;
+				if (row[word] & mask)
+					return true;
+			}
+		}
+		return false;
+	}
+
 	constexpr StrId GetLayerNameId(const GameMapLayer& layer)
 	{
 		return std::visit([](auto&& arg) -> StrId
@@ -0,0 +1,153 @@
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "types.h"
+
+namespace
+{
+	// More batches than threads so a thread that drew a slow range doesn't hold up the others
+	constexpr int kBatchesPerThread = 4;
+
+	// Set on workers for their lifetime and on the calling thread while it runs batches, a loop started inside a batch runs inline
+	thread_local bool isInsideLoop = false;
+
+	class WorkerPool
+	{
+	public:
+		WorkerPool()
+		{
+			const int workerCount = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1) - 1;
+			for (int i = 0; i < workerCount; ++i)
+				workers.emplace_back([this] { WorkerLoop(); });
+		}
+
+		~WorkerPool()
+		{
+			{
+				std::scoped_lock lock(mutex);
+				isStopping = true;
+			}
+			wake.notify_all();
+			for (std::thread& worker : workers)
+				worker.join();
+		}
+
+		int GetWorkerCount() const { return static_cast<int>(workers.size()); }
+
+		void Run(int count, int batchSize, const std::function<void(int, int)>& func)
+		{
+			std::scoped_lock runLock(runMutex);
+
+			{
+				// A worker that woke up late for the previous loop may still be looking at it
+				std::unique_lock lock(mutex);
+				done.wait(lock, [this] { return activeWorkers == 0; });
+
+				job = { &func, count, batchSize };
+				nextBegin.store(0, std::memory_order_relaxed);
+				++generation;
+			}
+			wake.notify_all();
+
+			isInsideLoop = true;
+			RunBatches(job);
+			isInsideLoop = false;
+
+			std::unique_lock lock(mutex);
+			done.wait(lock, [this] { return activeWorkers == 0; });
+			job = {};
+		}
+
+	private:
+		struct Job
+		{
+			const std::function<void(int, int)>* func = nullptr;
+			int count{};
+			int batchSize{};
+		};
+
+		void RunBatches(const Job& runJob)
+		{
+			for (int begin = nextBegin.fetch_add(runJob.batchSize, std::memory_order_relaxed); begin < runJob.count;
+				begin = nextBegin.fetch_add(runJob.batchSize, std::memory_order_relaxed))
+			{
+				(*runJob.func)(begin, std::min(begin + runJob.batchSize, runJob.count));
+			}
+		}
+
+		void WorkerLoop()
+		{
+			isInsideLoop = true;
+			uint64_t seenGeneration = 0;
+
+			while (true)
+			{
+				Job workerJob;
+				{
+					std::unique_lock lock(mutex);
+					wake.wait(lock, [&] { return isStopping || generation != seenGeneration; });
+					if (isStopping)
+						return;
+
+					seenGeneration = generation;
+					workerJob = job;
+					++activeWorkers;
+				}
+
+				if (workerJob.func)
+					RunBatches(workerJob);
+
+				{
+					std::scoped_lock lock(mutex);
+					--activeWorkers;
+				}
+				done.notify_all();
+			}
+		}
+
+		std::vector<std::thread> workers;
+		std::mutex runMutex;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable done;
+		Job job{};
+		std::atomic<int> nextBegin{};
+		uint64_t generation{};
+		int activeWorkers{};
+		bool isStopping = false;
+	};
+
+	WorkerPool& GetPool()
+	{
+		static WorkerPool pool;
+		return pool;
+	}
+}
+
+int jobs::GetWorkerCount()
+{
+	return GetPool().GetWorkerCount();
+}
+
+void jobs::ParallelFor(int count, int minBatchSize, const std::function<void(int begin, int end)>& func)
+{
+	ASSERT(minBatchSize >= 1 && "Invalid batch size.");
+	if (count <= 0)
+		return;
+
+	if (count <= minBatchSize || isInsideLoop || GetWorkerCount() == 0)
+	{
+		func(0, count);
+		return;
+	}
+
+	const int threadCount = GetWorkerCount() + 1;
+	const int batchSize = std::max(minBatchSize, (count + threadCount * kBatchesPerThread - 1) / (threadCount * kBatchesPerThread));
+	GetPool().Run(count, batchSize, func);
+}
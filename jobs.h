@@ -0,0 +1,16 @@
+#pragma once
+
+#include <functional>
+
+// Worker threads for splitting data parallel loops across cores, started on the first parallel loop and stopped at exit.
+// A loop blocks its caller until every batch has run, the caller works through batches as well instead of waiting idle.
+// Loops started from different threads run one after the other, a loop started from inside a batch runs inline on that thread.
+namespace jobs
+{
+	// Threads besides the calling thread that take batches
+	int GetWorkerCount();
+
+	// Calls func(begin, end) for consecutive ranges covering [0, count), each at least minBatchSize long except the last.
+	// Batches run concurrently in no particular order so func must only write state owned by its range.
+	void ParallelFor(int count, int minBatchSize, const std::function<void(int begin, int end)>& func);
+}
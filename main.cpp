@@ -2,6 +2,8 @@
 
 #include <array>
 #include <format>
+#include <future>
+#include <memory>
 #include <numbers>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
@@ -12,6 +14,8 @@
 #include "ecs.h"
 #include "input.h"
 #include "random.h"
+#include "schedule.h"
+#include "spatial.h"
 #include "sokol_time.h"
 #include "systems.h"
 #include "types.h"
@@ -207,7 +211,7 @@ struct TestSpawnerSystem : System<TestSpawnerSystem>
 				{
 					timer += interval;
 
-					Entity entity = GetWorld().CreateEntity();
+					Entity entity = GetWorld().CreateEntity(EntityCategory::Transient);
 					*search = entity;
 
 					ptrdiff_t index = std::distance(spawned.begin(), search);
@@ -244,6 +248,25 @@ struct TestSpawnerSystem : System<TestSpawnerSystem>
 };
 
 
+// Every world the game creates, including staging worlds, must register components in the same order so they can be merged
+void RegisterGameComponents(World& target)
+{
+	target.RegisterComponents<
+		TestColor, TestSize, TestIndex,
+		Expiration,
+		Transform, Velocity, PreviousTransform,
+		Parent, LocalTransform,
+		GameInputGather, GameInput,
+		PlayerControl, PlayerShootControl,
+		Facing, FacingSprites,
+		CameraView, GameCameraControl,
+		SpriteRender, GameMapRender,
+		EnemyTag, BulletTag,
+		Spawner, SpawnSource,
+		PhysicsBody, Collider::Box, Collider::Circle, PhysicsLayer, PhysicsNudge, Trigger,
+		Shared<SpriteRender>, Shared<Collider::Box>, Shared<PhysicsNudge>,
+		DebugMarker>();
+}
 
 int main(int argc, char* argv[])
 {
@@ -263,6 +286,10 @@ int main(int argc, char* argv[])
 
 	InitDevConsole(debug::DevConsoleConfig{ canvasX * 6, canvasY * 6, debugFont, renderer });
 	debug::DevConsoleAddCommand("sreport", [] {PrintStringReport(StrId::QueryStringReport()); return 0; });
+	debug::DevConsoleAddCommand("spatialbench", [] { RunSpatialBenchmark(); return 0; });
+#if ENABLE_ECS_TRACE
+	debug::DevConsoleAddCommand("ecstrace", [] { ecs::trace::Dump(world); ecs::trace::Clear(); return 0; });
+#endif
 
 	SpriteSheet sheet = sprite_sheet::Import("assets/spritesheet.tsj", renderer);
 	//SpriteSheet sheet = sprite_sheet::Create(renderer, "assets/spritesheet.png", 16, 16, 1);;
@@ -272,22 +299,45 @@ int main(int argc, char* argv[])
 	SpriteSheetViewContext ssv{ sheet, ssvFont, canvasX, canvasY };
 	debug::DevConsoleAddCommand("ssv", [&ssv] { ssv.visible = !ssv.visible; return 0; });
 
-	world.RegisterComponents<
-		TestColor, TestSize, TestIndex,
-		Expiration,
-		Transform, Velocity,
-		GameInputGather, GameInput,
-		PlayerControl, PlayerShootControl,
-		Facing, FacingSprites,
-		CameraView, GameCameraControl,
-		SpriteRender, GameMapRender,
-		EnemyTag,
-		Spawner, SpawnSource,
-		PhysicsBody, Collider::Box, Collider::Circle, PhysicsNudge,
-		DebugMarker>();
+	RegisterGameComponents(world);
+
+	world.RegisterEvents<EnemyKilled, TriggerBegin, TriggerEnd>();
+
+	// Level content is built in a staging world on a worker thread while systems are set up, then merged in before the first frame
+	std::future<std::unique_ptr<World>> levelStaging = std::async(std::launch::async, []
+		{
+			auto staging = std::make_unique<World>();
+			RegisterGameComponents(*staging);
+
+			Entity enemyPrefab = staging->CreateEntity(EntityCategory::Static);
+			staging->AddComponents(enemyPrefab,
+				Prefab{},
+				Transform{},
+				PreviousTransform{},
+				Velocity{},
+				Share(SpriteRender{ 26, SpriteFlipFlags::None, vec2::Half }),
+				EnemyTag{},
+				PhysicsBody{},
+				Share(PhysicsNudge{ 0.6f, 0.33f, 5.0f }),
+				Share(Collider::Box{ vec2::Zero, vec2::One * 0.45f }),
+				PhysicsLayer{ PhysicsLayerFlags::Enemy, ~PhysicsLayerFlags::Enemy });
+
+			constexpr int SPAWNER_COUNT = 5; int ct = 0;
+			for (auto spawnerEntities = staging->CreateEntities<SPAWNER_COUNT>(); Entity spawner : spawnerEntities)
+			{
+				staging->AddComponents(spawner,
+					Transform{ {3 + 1.2f * ct, 2 + 1.6f * ct} },
+					Spawner{ enemyPrefab, 3, 0, 2 });
+				++ct;
+			}
+
+			return staging;
+		});
 
 	auto expirationSystem = EntityExpirationSystem::Register(world);
 	auto viewSystem = ViewSystem::Register(world);
+	auto transformHistorySystem = TransformHistorySystem::Register(world);
+	auto transformHierarchySystem = TransformHierarchySystem::Register(world);
 	auto gatherInputSystem = GatherInputSystem::Register(world);
 	auto playerControlSystem = PlayerControlSystem::Register(world);
 	auto playerShootSystem = PlayerShootControlSystem::Register(world);
@@ -298,16 +348,23 @@ int main(int argc, char* argv[])
 	auto enemyFollowSystem = EnemyFollowTargetSystem::Register(world);
 	auto nudgeSystem = PhysicsNudgeSystem::Register(world);
 	auto physicsSystem = PhysicsSystem::Register(world);
+	auto collisionSystem = CollisionSystem::Register(world);
 	auto debugMarkerSystem = ColliderDebugDrawSystem::Register(world);
 	auto physicsBodyVelocitySystem = PhysicsBodyVelocitySystem::Register(world);
 	auto spawnerSystem = SpawnerSystem::Register(world);
+	auto bulletSystem = BulletSystem::Register(world);
 	//auto testSystem = TestSystem::Register(world);
 	//auto testSpawnSystem = TestSpawnerSystem::Register(world);
 
-	auto [cameraEntity, mapEntity, playerEntity] = world.CreateEntities<3>();
+	auto [cameraEntity, mapEntity, playerEntity] = world.CreateEntities<3>(EntityCategory::Static);
 
 	physicsSystem->SetMap(map);
 	enemyFollowSystem->targetEntity = playerEntity;
+	bulletSystem->physicsSystem = physicsSystem.get();
+	bulletSystem->collisionSystem = collisionSystem.get();
+	physicsBodyVelocitySystem->physicsSystem = physicsSystem.get();
+	nudgeSystem->physicsSystem = physicsSystem.get();
+	collisionSystem->physicsSystem = physicsSystem.get();
 
 	debug::DevConsoleAddCommand("reload", [&]
 		{
@@ -327,31 +384,37 @@ int main(int argc, char* argv[])
 		Transform{},
 		GameMapRender{ map });
 
+	Entity bulletPrefab = world.CreateEntity(EntityCategory::Static);
+	world.AddComponents(bulletPrefab,
+		Prefab{},
+		Transform{},
+		PreviousTransform{},
+		Velocity{},
+		PhysicsBody{},
+		Facing{},
+		SpriteRender{ 14, SpriteFlipFlags::None, vec2::Half },
+		Expiration{ 1.0f },
+		BulletTag{},
+		Collider::Circle{ vec2::Zero, 0.2f },
+		PhysicsLayer{ PhysicsLayerFlags::Bullet, PhysicsLayerFlags::Enemy },
+		Trigger{});
+
 	world.AddComponents(playerEntity,
 		Transform{ {8, 5} },
+		PreviousTransform{},
 		GameInput{},
 		GameInputGather{},
 		PlayerControl{},
-		PlayerShootControl{ 0.15f },
+		PlayerShootControl{ 0.15f, 0.0f, bulletPrefab },
 		Facing{ Direction::Right },
 		Velocity{},
 		FacingSprites{ 13, 11, 12 },
 		SpriteRender{ 10, SpriteFlipFlags::None, vec2::Half },
-		Collider::Box{ vec2::Zero, vec2::One * 0.45f },
+		Share(Collider::Box{ vec2::Zero, vec2::One * 0.45f }),
+		PhysicsLayer{ PhysicsLayerFlags::Player },
 		PhysicsBody{},
 		DebugMarker{});
 
-	Entity enemyPrefab = world.CreateEntity();
-	world.AddComponents(enemyPrefab,
-		Prefab{},
-		Transform{},
-		Velocity{},
-		SpriteRender{ 26, SpriteFlipFlags::None, vec2::Half },
-		EnemyTag{},
-		PhysicsBody{},
-		PhysicsNudge{ 0.6f, 0.33f, 5.0f },
-		Collider::Box{ vec2::Zero, vec2::One * 0.45f });
-
 	auto findSafeSpot = [physicsSystem](const std::function<Vec2()>& gen, Vec2 halfSize) -> std::pair<bool, Vec2>
 	{
 		Vec2 position;
@@ -371,20 +434,15 @@ int main(int argc, char* argv[])
 		return Vec2{ rng.RangeF(bounds.Left(), bounds.Right()), rng.RangeF(bounds.Top(), bounds.Bottom()) };
 	};
 
-	constexpr int SPAWNER_COUNT = 5; int ct = 0;
-	for (auto spawnerEntities = world.CreateEntities<SPAWNER_COUNT>(); Entity spawner : spawnerEntities)
+	std::unique_ptr<World> staging = levelStaging.get();
+	EntityRemap levelRemap = world.MergeFrom(*staging);
+	for (Entity entity : levelRemap | std::views::values)
 	{
-		//if (auto [found, position] = findSafeSpot(randomMapPosition, vec2::Half); found)
-		//{
-		//	//world.AddComponents(spawner, Transform{position}, Spawner{ enemyPrefab, rng.RangeF(5.0f, 10.0f), rng.RangeF(1, 10), 6 });
-		//	world.AddComponents(spawner,
-		//		Transform{position},
-		//		Spawner{ enemyPrefab, 0.5f, 0.5f, 4 });
-		//}
-		world.AddComponents(spawner,
-			Transform{ {3 + 1.2f * ct, 2 + 1.6f * ct} },
-			Spawner{ enemyPrefab, 3, 0, 2 });
-		++ct;
+		if (world.HasComponent<Spawner>(entity))
+		{
+			Spawner& spawner = world.GetComponent<Spawner>(entity);
+			spawner.prefab = levelRemap.at(spawner.prefab);
+		}
 	}
 
 	constexpr int ENEMY_COUNT = 0;
@@ -409,16 +467,59 @@ int main(int argc, char* argv[])
 		world.AddComponents(enemy,
 			Transform{ position },
 			Velocity{},
-			SpriteRender{ 26, SpriteFlipFlags::None, vec2::Half },
+			Share(SpriteRender{ 26, SpriteFlipFlags::None, vec2::Half }),
 			EnemyTag{},
 			PhysicsBody{},
-			PhysicsNudge{ 0.6f, 0.33f, 5.0f },
-			Collider::Box{ vec2::Zero, vec2::One * 0.45f });
+			Share(PhysicsNudge{ 0.6f, 0.33f, 5.0f }),
+			Share(Collider::Box{ vec2::Zero, vec2::One * 0.45f }));
 	}
 #endif
 
 	cameraControlSystem->SnapFocusToFollow(cameraEntity);
 
+	bool showColliders = false;
+
+	Schedule schedule(world);
+	schedule.Add(Stage::Input, "GatherInput", gatherInputSystem);
+	schedule.Add(Stage::Input, "SpawnerKillInput", [spawnerSystem](const GameTime&) { spawnerSystem->GatherInput(); });
+	schedule.Add(Stage::Input, "SpriteSheetView", [&ssv](const GameTime&) { SpriteSheetViewControl(ssv); });
+
+	// Registered first so it runs before anything else in the tick, ties in the stage order go to registration order
+	schedule.Add(Stage::Simulation, "TransformHistory", transformHistorySystem);
+	schedule.Add(Stage::Simulation, "Expiration", expirationSystem);
+	schedule.Add(Stage::Simulation, "SpawnerKills", [spawnerSystem](const GameTime& time) { spawnerSystem->UpdateKills(time); });
+	schedule.Add(Stage::Simulation, "Spawner", spawnerSystem, { .after = { "SpawnerKills" } }, { .tickRate = 10.0f });
+	schedule.Add(Stage::Simulation, "PlayerControl", playerControlSystem);
+	schedule.Add(Stage::Simulation, "PlayerShoot", playerShootSystem, { .after = { "PlayerControl" } });
+	schedule.Add(Stage::Simulation, "EnemyFollow", enemyFollowSystem, {}, { .slices = 3 });
+	schedule.Add(Stage::Simulation, "SpriteFacing", spriteFacingSystem, { .after = { "PlayerControl" } });
+	//schedule.Add(Stage::Simulation, "TestSpawn", testSpawnSystem);
+	//schedule.Add(Stage::Simulation, "Test", testSystem, { .after = { "TestSpawn" } });
+
+	schedule.Add(Stage::Physics, "PhysicsBodyVelocity", physicsBodyVelocitySystem);
+	schedule.Add(Stage::Physics, "Bullets", bulletSystem, { .after = { "PhysicsBodyVelocity" }, .before = { "Physics" } });
+	schedule.Add(Stage::Physics, "PhysicsNudge", nudgeSystem, { .after = { "PhysicsBodyVelocity" } });
+	schedule.Add(Stage::Physics, "Physics", physicsSystem, { .after = { "PhysicsNudge" } });
+	schedule.Add(Stage::Physics, "Collision", collisionSystem, { .after = { "Physics" } });
+	schedule.Add(Stage::Physics, "BulletHits", [bulletSystem](const GameTime&) { bulletSystem->ResolveHits(); }, { .after = { "Collision" } });
+
+	schedule.Add(Stage::PostPhysics, "TransformHierarchy", transformHierarchySystem, { .before = { "CameraControl" } });
+	schedule.Add(Stage::PostPhysics, "CameraControl", cameraControlSystem);
+	schedule.Add(Stage::PostPhysics, "View", viewSystem, { .after = { "CameraControl" } });
+
+	schedule.Add(Stage::Render, "GameMapRender", [&](const GameTime&) { gameMapRenderSystem->RenderLayers(drawContext, std::array{ StrId("Background") }); });
+	schedule.Add(Stage::Render, "SpriteRender", [&](const GameTime& time) { spriteRenderSystem->Render(drawContext, time.alpha()); }, { .after = { "GameMapRender" } });
+	schedule.Add(Stage::Render, "ColliderDebugDraw", [&](const GameTime&) { if (showColliders) debugMarkerSystem->DrawMarkers(drawContext); }, { .after = { "SpriteRender" } });
+	//schedule.Add(Stage::Render, "Test", [&](const GameTime&) { testSystem->Render(drawContext, viewSystem->ActiveCamera()); });
+	schedule.Add(Stage::Render, "SpriteSheetView", [&](const GameTime&) { SpriteSheetViewRender(drawContext, ssv); }, { .after = { "ColliderDebugDraw" } });
+
+	debug::DevConsoleAddCommand("tickrate", [&schedule](int rate)
+		{
+			rate = std::max(rate, 1);
+			schedule.SetFixedStep(FixedStep{ static_cast<float>(rate) });
+			return rate;
+		});
+
 	int targetFrames = 60;
 	double targetFrameTime = 1.0 / targetFrames;
 	debug::DevConsoleAddCommand("setfps", [&targetFrames, &targetFrameTime](int target)
@@ -440,7 +541,6 @@ int main(int argc, char* argv[])
 	uint64_t averageFrameTick = 0;
 
 	bool isRunning = true;
-	bool showColliders = false;
 #ifdef _DEBUG
 	bool showDebugWatch = true;
 #else
@@ -508,33 +608,14 @@ int main(int argc, char* argv[])
 
 		debug::Watch("FPS: {:d}, Frame: {:.3f}ms, Max: {:.3f}ms", fps, stm_ms(averageFrameTick), stm_ms(*std::ranges::max_element(frameTickMeasures)));
 		debug::Watch("Entities: {:d}", world.GetEntityCount());
+		debug::Watch("Awake bodies: {:d}", physicsSystem->GetAwakeCount());
+		schedule.WatchTimings();
 
 		GameTime gameTime(elapsedSec, deltaSec);
 
-		expirationSystem->Update(gameTime);
-		spawnerSystem->Update(gameTime);
-		gatherInputSystem->Update(gameTime);
-		playerControlSystem->Update(gameTime);
-		playerShootSystem->Update(gameTime);
-		enemyFollowSystem->Update(gameTime);
-		spriteFacingSystem->Update();
-		physicsBodyVelocitySystem->Update(gameTime);
-		nudgeSystem->Update(gameTime);
-		physicsSystem->Update(gameTime);
-		cameraControlSystem->Update(gameTime);
-		viewSystem->Update(gameTime);
-		//testSpawnSystem->Update(gameTime);
-		//testSystem->Update(gameTime);
-
-		SpriteSheetViewControl(ssv);
-
 		draw::Clear(drawContext);
-		gameMapRenderSystem->RenderLayers(drawContext, std::array{ StrId("Background") });
-		spriteRenderSystem->Render(drawContext);
-		if (showColliders) debugMarkerSystem->DrawMarkers(drawContext);
-		//testSystem->Render(drawContext, viewSystem->ActiveCamera());
 
-		SpriteSheetViewRender(drawContext, ssv);
+		schedule.Run(gameTime);
 
 		if (showDebugWatch)
 		{
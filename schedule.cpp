@@ -0,0 +1,220 @@
+#include "schedule.h"
+
+#include <sokol_time.h>
+
+#include "debug.h"
+
+// Time spent each frame co-sorting the component storage of owning queries, see World::OwnStorage
+constexpr std::chrono::microseconds kStorageReorderBudget{ 250 };
+
+const char* GetStageName(Stage stage)
+{
+	switch (stage)
+	{
+	case Stage::Input: return "Input";
+	case Stage::Simulation: return "Simulation";
+	case Stage::Physics: return "Physics";
+	case Stage::PostPhysics: return "PostPhysics";
+	case Stage::Render: return "Render";
+	default: return "Invalid";
+	}
+}
+
+bool IsFixedStage(Stage stage)
+{
+	return stage == Stage::Simulation || stage == Stage::Physics;
+}
+
+void Schedule::SetFixedStep(FixedStep step)
+{
+	ASSERT(step.tickRate > 0.0f && step.maxTicksPerFrame >= 1 && "Invalid fixed step.");
+	fixedStep = step;
+}
+
+void Schedule::Add(Stage stage, StrId name, UpdateFunc update, ScheduleOrder order, ScheduleRate rate)
+{
+	StageData& stageData = stages[stage];
+
+	ASSERT(std::ranges::none_of(stageData.entries, [name](const Entry& e) { return e.name == name; }) && "System already added to stage.");
+	ASSERT(rate.tickRate >= 0.0f && rate.slices >= 1 && "Invalid schedule rate.");
+
+	stageData.entries.emplace_back(Entry{ name, std::move(update), std::move(order), rate, 0.0, 0, std::vector<double>(rate.slices, -1.0) });
+	stageData.isOrderDirty = true;
+}
+
+void Schedule::Run(const GameTime& time)
+{
+	const double tickSec = 1.0 / fixedStep.tickRate;
+	fixedAccumulatorSec += time.dt();
+
+	world.SetEventsReadable(false);
+	for (Stage stage = Stage::Input; stage < Stage::Simulation; ++stage)
+		RunStage(stage, time);
+	world.SetEventsReadable(true);
+
+	int tickCount = 0;
+	while (fixedAccumulatorSec >= tickSec && tickCount < fixedStep.maxTicksPerFrame)
+	{
+		world.SwapEvents();
+
+		GameTime tickTime(fixedElapsedSec, tickSec);
+		for (Stage stage = Stage::Simulation; stage < Stage::Count && IsFixedStage(stage); ++stage)
+			RunStage(stage, tickTime);
+
+		fixedAccumulatorSec -= tickSec;
+		fixedElapsedSec += tickSec;
+		++tickCount;
+	}
+
+	// Spiral of death guard, time the ticks couldn't keep up with is dropped
+	fixedAccumulatorSec = std::min(fixedAccumulatorSec, tickSec);
+
+	GameTime frameTime(time.t(), time.dt(), fixedAccumulatorSec / tickSec);
+	world.SetEventsReadable(false);
+	for (Stage stage = Stage::PostPhysics; stage < Stage::Count; ++stage)
+		RunStage(stage, frameTime);
+	world.SetEventsReadable(true);
+
+	world.ReorderStorage(kStorageReorderBudget);
+}
+
+void Schedule::RunStage(Stage stage, const GameTime& time)
+{
+	StageData& stageData = stages[stage];
+
+	if (stageData.isOrderDirty)
+		BuildExecutionOrder(stageData);
+
+	uint64_t startTicks = stm_now();
+
+	for (size_t entryIndex : stageData.executionOrder)
+	{
+		RunEntry(stageData.entries[entryIndex], time);
+	}
+
+	world.ApplyDeferred();
+
+	*stageData.tickMeasures.next() = stm_diff(stm_now(), startTicks);
+	if (stageData.tickMeasures.index() == 0)
+		stageData.averageTicks = types::average(stageData.tickMeasures);
+}
+
+void Schedule::WatchTimings() const
+{
+	for (Stage stage = Stage::Input; stage < Stage::Count; ++stage)
+	{
+		debug::Watch("{}: {:.3f}ms", GetStageName(stage), stm_ms(stages[stage].averageTicks));
+	}
+}
+
+// Entries with a tick rate run at most once per frame whenever a tick interval has accumulated, at most one tick is carried over so a slow frame doesn't cause a burst.
+// Sliced entries cycle through their slices one per tick and each slice is given the time since that slice last ran.
+void Schedule::RunEntry(Entry& entry, const GameTime& time)
+{
+	if (entry.rate.tickRate <= 0.0f && entry.rate.slices == 1)
+	{
+		currentSlice = {};
+		entry.update(time);
+		return;
+	}
+
+	if (entry.rate.tickRate > 0.0f)
+	{
+		double interval = 1.0 / entry.rate.tickRate;
+		entry.tickAccumulator += time.dt();
+		if (entry.tickAccumulator < interval)
+			return;
+		entry.tickAccumulator = std::min(entry.tickAccumulator - interval, interval);
+	}
+
+	int slice = entry.nextSlice;
+	entry.nextSlice = (entry.nextSlice + 1) % entry.rate.slices;
+
+	// The first run of a slice has nothing to compensate for
+	double& lastRunSec = entry.sliceLastRunSec[slice];
+	double deltaSec = lastRunSec < 0.0 ? time.dt() : time.t() - lastRunSec;
+	lastRunSec = time.t();
+
+	currentSlice = { slice, entry.rate.slices };
+	entry.update(GameTime(time.t(), deltaSec));
+	currentSlice = {};
+}
+
+// Topological sort of the stage entries using their before/after constraints.
+// Ties are broken by registration order so a stage without constraints runs in the order systems were added.
+void Schedule::BuildExecutionOrder(StageData& stage)
+{
+	const size_t count = stage.entries.size();
+
+	auto findEntry = [&stage](StrId name) -> std::optional<size_t>
+	{
+		for (size_t i = 0; i < stage.entries.size(); ++i)
+		{
+			if (stage.entries[i].name == name)
+				return i;
+		}
+		return {};
+	};
+
+	std::vector<std::vector<size_t>> edges(count);
+	std::vector<int> incoming(count, 0);
+
+	auto addEdge = [&edges, &incoming](size_t from, size_t to)
+	{
+		edges[from].emplace_back(to);
+		incoming[to]++;
+	};
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		// Constraints naming systems outside of this stage are already satisfied by stage order
+		for (StrId after : stage.entries[i].order.after)
+		{
+			if (auto other = findEntry(after))
+				addEdge(*other, i);
+		}
+
+		for (StrId before : stage.entries[i].order.before)
+		{
+			if (auto other = findEntry(before))
+				addEdge(i, *other);
+		}
+	}
+
+	stage.executionOrder.clear();
+	stage.executionOrder.reserve(count);
+	std::vector<bool> scheduled(count, false);
+
+	while (stage.executionOrder.size() < count)
+	{
+		size_t index = count;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (!scheduled[i] && incoming[i] == 0)
+			{
+				index = i;
+				break;
+			}
+		}
+
+		if (index == count)
+		{
+			ASSERT(false && "Cycle in schedule ordering constraints.");
+			debug::Log("Warning: cycle in schedule ordering constraints, remaining systems run in registration order.");
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (!scheduled[i])
+					stage.executionOrder.emplace_back(i);
+			}
+			break;
+		}
+
+		scheduled[index] = true;
+		stage.executionOrder.emplace_back(index);
+
+		for (size_t to : edges[index])
+			incoming[to]--;
+	}
+
+	stage.isOrderDirty = false;
+}
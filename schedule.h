@@ -0,0 +1,112 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "ecs.h"
+#include "enumflag.h"
+#include "stringid.h"
+#include "types.h"
+
+// Stages run in declaration order every frame.
+// Simulation and Physics are fixed stages, they run together once per fixed tick for as many ticks as the frame time has accumulated, see FixedStep.
+// The end of each stage is a sync point where deferred world changes are applied.
+// Event channels are swapped at the start of every fixed tick so events sent during one tick are read during the next, only the fixed stages may read them.
+// After the last stage a time budgeted pass reorders component storage for owning queries.
+enum class Stage
+{
+	Input,
+	Simulation,
+	Physics,
+	PostPhysics,
+	Render,
+	Count,
+};
+
+const char* GetStageName(Stage stage);
+bool IsFixedStage(Stage stage);
+
+// Fixed stages are given a delta of exactly 1 / tickRate. Frames that would need more than maxTicksPerFrame ticks drop the excess time
+// so a slow frame can't make the next one slower. Stages after the fixed stages get the frame time with GameTime::alpha set.
+struct FixedStep
+{
+	float tickRate = 120.0f;
+	int maxTicksPerFrame = 8;
+};
+
+// Ordering constraints against other systems registered to the same stage, referenced by name
+struct ScheduleOrder
+{
+	std::vector<StrId> after{};
+	std::vector<StrId> before{};
+};
+
+// How often an entry runs. The time passed to an entry is the time since it last ran, or since its slice last ran when sliced.
+struct ScheduleRate
+{
+	float tickRate = 0.0f;	// Ticks per second, 0 ticks every frame
+	int slices = 1;			// Systems update 1/slices of their entities per tick, see System::GetSliceRange
+};
+
+class Schedule
+{
+public:
+	using UpdateFunc = std::function<void(const GameTime&)>;
+
+	explicit Schedule(World& world) : world(world) {}
+
+	void SetFixedStep(FixedStep step);
+
+	void Add(Stage stage, StrId name, UpdateFunc update, ScheduleOrder order = {}, ScheduleRate rate = {});
+
+	template <typename T>
+	auto Add(Stage stage, StrId name, const std::shared_ptr<T>& system, ScheduleOrder order = {}, ScheduleRate rate = {}) -> std::enable_if_t<std::is_base_of_v<SystemBase, T>, void>
+	{
+		Add(stage, name, [this, system](const GameTime& time)
+			{
+				system->SetSlice(currentSlice);
+				if constexpr (std::is_invocable_v<decltype(&T::Update), T*, const GameTime&>)
+					system->Update(time);
+				else
+					system->Update();
+			}, std::move(order), rate);
+	}
+
+	void Run(const GameTime& time);
+	void RunStage(Stage stage, const GameTime& time);
+
+	// Writes the average time spent in each stage to the debug watch
+	void WatchTimings() const;
+
+private:
+	struct Entry
+	{
+		StrId name;
+		UpdateFunc update;
+		ScheduleOrder order;
+		ScheduleRate rate;
+		double tickAccumulator{};
+		int nextSlice{};
+		std::vector<double> sliceLastRunSec{};
+	};
+
+	struct StageData
+	{
+		std::vector<Entry> entries{};
+		std::vector<size_t> executionOrder{};
+		bool isOrderDirty = false;
+		ring_buf<uint64_t, 60> tickMeasures{};
+		uint64_t averageTicks{};
+	};
+
+	static void BuildExecutionOrder(StageData& stage);
+	void RunEntry(Entry& entry, const GameTime& time);
+
+	World& world;
+	FixedStep fixedStep{};
+	double fixedAccumulatorSec{};
+	double fixedElapsedSec{};
+	SystemSlice currentSlice{};
+	enum_array<StageData, Stage> stages{};
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <span>
+
+#include "types.h"
+
+// Streaming kernels over contiguous arrays of vectors, such as the owned field spans of a query.
+// A Vec2 array is a plain float array of interleaved x/y so component wise math runs on whole registers without shuffling:
+// AVX2 handles 4 vectors per instruction when the compiler targets it, otherwise SSE2 which every x64 target has handles 2.
+// The tail that doesn't fill a register is done in scalar code.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE2 1
+#endif
+
+static_assert(sizeof(Vec2) == 2 * sizeof(float), "Vec2 must be two packed floats.");
+
+namespace simd
+{
+	// values[i] += deltas[i]
+	inline void AddVec2(std::span<Vec2> values, std::span<const Vec2> deltas)
+	{
+		ASSERT(values.size() == deltas.size() && "Span sizes don't match.");
+
+		float* out = reinterpret_cast<float*>(values.data());
+		const float* in = reinterpret_cast<const float*>(deltas.data());
+		const size_t floatCount = values.size() * 2;
+		size_t i = 0;
+
+#if defined(SIMD_AVX2)
+		for (; i + 8 <= floatCount; i += 8)
+			_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_loadu_ps(in + i)));
+#elif defined(SIMD_SSE2)
+		for (; i + 4 <= floatCount; i += 4)
+			_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_loadu_ps(in + i)));
+#endif
+
+		for (; i < floatCount; ++i)
+			out[i] += in[i];
+	}
+}
@@ -0,0 +1,163 @@
+#include "spatial.h"
+
+#include <bit>
+#include <sokol_time.h>
+
+#include "debug.h"
+#include "random.h"
+
+void SpatialIndex::Clear()
+{
+	positions.clear();
+	radii.clear();
+	maxRadius = 0.0f;
+}
+
+int SpatialIndex::Insert(Vec2 position, float radius)
+{
+	ASSERT(radius >= 0.0f && "Negative spatial index radius.");
+	positions.emplace_back(position);
+	radii.emplace_back(radius);
+	maxRadius = std::max(maxRadius, radius);
+	return static_cast<int>(positions.size()) - 1;
+}
+
+// Counting sort: count the items of every bucket, prefix sum the counts into start offsets, then scatter the items
+void SpatialIndex::Build(float size)
+{
+	const int count = Count();
+
+	cellSize = size > 0.0f ? size : std::max(2.0f * maxRadius, 0.001f);
+	inverseCellSize = 1.0f / cellSize;
+
+	uint32_t bucketCount = std::bit_ceil(static_cast<uint32_t>(std::max(count * 2, 64)));
+	bucketMask = bucketCount - 1;
+
+	bucketStarts.assign(bucketCount + 1, 0);
+	itemBuckets.resize(count);
+	sortedItems.resize(count);
+	sortedCells.resize(count);
+	sortedPositions.resize(count);
+	sortedRadii.resize(count);
+
+	itemBounds = count > 0 ? Bounds2D{ positions[0], positions[0] } : Bounds2D{};
+	for (int item = 0; item < count; ++item)
+	{
+		Vec2 position = positions[item];
+		itemBounds.min = { std::min(itemBounds.min.x, position.x), std::min(itemBounds.min.y, position.y) };
+		itemBounds.max = { std::max(itemBounds.max.x, position.x), std::max(itemBounds.max.y, position.y) };
+
+		uint32_t bucket = HashCell(GetCell(position));
+		itemBuckets[item] = bucket;
+		bucketStarts[bucket + 1]++;
+	}
+
+	for (uint32_t bucket = 0; bucket < bucketCount; ++bucket)
+		bucketStarts[bucket + 1] += bucketStarts[bucket];
+
+	// Scatter using the starts as write cursors then shift them back, this keeps items of a bucket in insertion order
+	for (int item = 0; item < count; ++item)
+	{
+		int sorted = bucketStarts[itemBuckets[item]]++;
+		sortedItems[sorted] = item;
+		sortedCells[sorted] = GetCell(positions[item]);
+		sortedPositions[sorted] = positions[item];
+		sortedRadii[sorted] = radii[item];
+	}
+
+	for (uint32_t bucket = bucketCount; bucket > 0; --bucket)
+		bucketStarts[bucket] = bucketStarts[bucket - 1];
+	bucketStarts[0] = 0;
+}
+
+// The search circle doubles until it holds enough items or covers every item, each pass is exact for items inside the circle
+int SpatialIndex::QueryNearest(Vec2 point, std::span<int> nearest, float maxDistance) const
+{
+	if (nearest.empty() || sortedItems.empty())
+		return 0;
+
+	float farthestSqr = 0.0f;
+	for (const Vec2& corner : itemBounds.Corners())
+		farthestSqr = std::max(farthestSqr, vec2::LengthSqr(corner - point));
+
+	std::vector<std::pair<float, int>> candidates;
+	float radius = cellSize;
+	while (true)
+	{
+		radius = std::min(radius, maxDistance);
+		const float radiusSqr = radius * radius;
+
+		candidates.clear();
+		Vec2 reach{ radius, radius };
+		ForEachInCells(point - reach, point + reach, [&](int sorted)
+		{
+			float distanceSqr = vec2::LengthSqr(sortedPositions[sorted] - point);
+			if (distanceSqr <= radiusSqr)
+				candidates.emplace_back(distanceSqr, sortedItems[sorted]);
+		});
+
+		if (candidates.size() >= nearest.size() || radius >= maxDistance || radiusSqr >= farthestSqr)
+			break;
+
+		radius *= 2.0f;
+	}
+
+	size_t resultCount = std::min(candidates.size(), nearest.size());
+	std::partial_sort(candidates.begin(), candidates.begin() + resultCount, candidates.end());
+	for (size_t i = 0; i < resultCount; ++i)
+		nearest[i] = candidates[i].second;
+
+	return static_cast<int>(resultCount);
+}
+
+// Items are spread at a constant density so the neighbor count per item stays the same as the item count grows
+void RunSpatialBenchmark()
+{
+	constexpr float kRadius = 0.6f;
+	constexpr float kItemsPerUnitArea = 0.5f;
+	constexpr int kMaxAllPairsCount = 5000;
+
+	random::PcgGen rng(1234u);
+	SpatialIndex index;
+
+	debug::Log("Spatial index benchmark, radius {:.2f}", kRadius);
+	for (int count : { 100, 500, 1000, 2000, 5000, 10000, 20000 })
+	{
+		float side = std::sqrt(static_cast<float>(count) / kItemsPerUnitArea);
+
+		index.Clear();
+		for (int i = 0; i < count; ++i)
+			index.Insert({ rng.NextF(side), rng.NextF(side) }, kRadius);
+
+		uint64_t startTicks = stm_now();
+		index.Build();
+		uint64_t buildTicks = stm_since(startTicks);
+
+		int pairCount = 0;
+		startTicks = stm_now();
+		index.ForEachOverlappingPair([&pairCount](int, int, Vec2, float) { ++pairCount; });
+		uint64_t pairTicks = stm_since(startTicks);
+
+		if (count > kMaxAllPairsCount)
+		{
+			debug::Log("    {:5d}: build {:.3f}ms, pairs {:.3f}ms ({} pairs)", count, stm_ms(buildTicks), stm_ms(pairTicks), pairCount);
+			continue;
+		}
+
+		int allPairsCount = 0;
+		startTicks = stm_now();
+		for (int a = 0; a < count - 1; ++a)
+		{
+			for (int b = a + 1; b < count; ++b)
+			{
+				float totalRadius = index.GetRadius(a) + index.GetRadius(b);
+				if (vec2::LengthSqr(index.GetPosition(b) - index.GetPosition(a)) <= totalRadius * totalRadius)
+					++allPairsCount;
+			}
+		}
+		uint64_t allPairsTicks = stm_since(startTicks);
+
+		ASSERT(pairCount == allPairsCount && "Spatial index missed overlapping pairs.");
+		debug::Log("    {:5d}: build {:.3f}ms, pairs {:.3f}ms ({} pairs), all pairs {:.3f}ms", count, stm_ms(buildTicks), stm_ms(pairTicks), pairCount, stm_ms(allPairsTicks));
+	}
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "types.h"
+
+// Uniform grid spatial hash over circles, used as a broadphase by systems that would otherwise compare every pair of entities.
+// The index is rebuilt from scratch whenever the positions change: insert every item, then Build counting sorts them by cell so
+// the items of a cell are contiguous. Cells are hashed into a table sized from the item count so the grid has no bounds,
+// every item remembers its cell so hash collisions are skipped without a distance check.
+// Queries are const and keep no state so any number of threads can query a built index.
+class SpatialIndex
+{
+public:
+	void Clear();
+
+	// Returns the item index passed back by queries, items are numbered in insertion order
+	int Insert(Vec2 position, float radius);
+
+	// A cell size of 0 uses twice the largest inserted radius so overlapping items are always in neighboring cells
+	void Build(float cellSize = 0.0f);
+
+	int Count() const { return static_cast<int>(positions.size()); }
+	float GetCellSize() const { return cellSize; }
+	Vec2 GetPosition(int item) const { return positions[item]; }
+	float GetRadius(int item) const { return radii[item]; }
+
+	// Calls func(item) for every item whose circle overlaps the circle
+	template <typename F>
+	void QueryCircle(Vec2 center, float radius, F&& func) const;
+
+	// Calls func(item) for every item whose circle overlaps the box
+	template <typename F>
+	void QueryBox(const Bounds2D& box, F&& func) const;
+
+	// Writes up to nearest.size() items ordered by the distance of their center to point, returns how many were written
+	int QueryNearest(Vec2 point, std::span<int> nearest, float maxDistance = std::numeric_limits<float>::max()) const;
+
+	// Calls func(itemA, itemB, delta, distanceSqr) once for every pair of overlapping circles, delta points from itemA to itemB
+	template <typename F>
+	void ForEachOverlappingPair(F&& func) const;
+
+	// Items in cell order, sorted positions [0, Count()) split into ranges give batches of whole runs of cells that can be processed in parallel
+	int GetSortedItem(int sorted) const { return sortedItems[sorted]; }
+
+	// Calls func(otherItem, delta, distanceSqr) for every item overlapping the item at sorted position, delta points away from it.
+	// Every pair is seen from both of its items, always in the same order for a given build.
+	template <typename F>
+	void ForEachOverlapOfSorted(int sorted, F&& func) const;
+
+private:
+	struct Cell
+	{
+		int x{}, y{};
+		bool operator==(const Cell& other) const = default;
+	};
+
+	Cell GetCell(Vec2 position) const
+	{
+		return { math::FloorToInt(position.x * inverseCellSize), math::FloorToInt(position.y * inverseCellSize) };
+	}
+
+	uint32_t HashCell(Cell cell) const
+	{
+		return (static_cast<uint32_t>(cell.x) * 73856093u ^ static_cast<uint32_t>(cell.y) * 19349663u) & bucketMask;
+	}
+
+	// Calls func(sortedIndex) for every item whose center is in a cell overlapping min/max
+	template <typename F>
+	void ForEachInCells(Vec2 min, Vec2 max, F&& func) const;
+
+	float cellSize = 1.0f;
+	float inverseCellSize = 1.0f;
+	float maxRadius = 0.0f;
+	uint32_t bucketMask = 0;
+	Bounds2D itemBounds{};
+
+	// Insertion order
+	std::vector<Vec2> positions;
+	std::vector<float> radii;
+	std::vector<uint32_t> itemBuckets;
+
+	// Cell order, the items of bucket b are [bucketStarts[b], bucketStarts[b + 1])
+	std::vector<int> bucketStarts;
+	std::vector<int> sortedItems;
+	std::vector<Cell> sortedCells;
+	std::vector<Vec2> sortedPositions;
+	std::vector<float> sortedRadii;
+};
+
+// Scaling benchmark of building the index and finding overlapping pairs against the all pairs loop, results are written to the log
+void RunSpatialBenchmark();
+
+template <typename F>
+void SpatialIndex::ForEachInCells(Vec2 min, Vec2 max, F&& func) const
+{
+	if (sortedItems.empty())
+		return;
+
+	Cell minCell = GetCell(min);
+	Cell maxCell = GetCell(max);
+
+	// A query covering more cells than there are items is cheaper as a linear pass
+	int64_t cellCount = static_cast<int64_t>(maxCell.x - minCell.x + 1) * (maxCell.y - minCell.y + 1);
+	if (cellCount > static_cast<int64_t>(sortedItems.size()))
+	{
+		for (int sorted = 0; sorted < static_cast<int>(sortedItems.size()); ++sorted)
+		{
+			Cell cell = sortedCells[sorted];
+			if (cell.x >= minCell.x && cell.x <= maxCell.x && cell.y >= minCell.y && cell.y <= maxCell.y)
+				func(sorted);
+		}
+		return;
+	}
+
+	for (int y = minCell.y; y <= maxCell.y; ++y)
+	{
+		for (int x = minCell.x; x <= maxCell.x; ++x)
+		{
+			Cell cell{ x, y };
+			uint32_t bucket = HashCell(cell);
+			for (int sorted = bucketStarts[bucket]; sorted < bucketStarts[bucket + 1]; ++sorted)
+			{
+				if (sortedCells[sorted] == cell)
+					func(sorted);
+			}
+		}
+	}
+}
+
+template <typename F>
+void SpatialIndex::QueryCircle(Vec2 center, float radius, F&& func) const
+{
+	Vec2 reach{ radius + maxRadius, radius + maxRadius };
+	ForEachInCells(center - reach, center + reach, [&](int sorted)
+	{
+		float totalRadius = radius + sortedRadii[sorted];
+		if (vec2::LengthSqr(sortedPositions[sorted] - center) <= totalRadius * totalRadius)
+			func(sortedItems[sorted]);
+	});
+}
+
+template <typename F>
+void SpatialIndex::QueryBox(const Bounds2D& box, F&& func) const
+{
+	Vec2 reach{ maxRadius, maxRadius };
+	ForEachInCells(box.min - reach, box.max + reach, [&](int sorted)
+	{
+		Vec2 position = sortedPositions[sorted];
+		float radius = sortedRadii[sorted];
+		if (vec2::LengthSqr(box.ClampPoint(position) - position) <= radius * radius)
+			func(sortedItems[sorted]);
+	});
+}
+
+template <typename F>
+void SpatialIndex::ForEachOverlapOfSorted(int sorted, F&& func) const
+{
+	const int reach = std::max(1, static_cast<int>(std::ceil(2.0f * maxRadius * inverseCellSize)));
+	const Cell cellA = sortedCells[sorted];
+	const Vec2 positionA = sortedPositions[sorted];
+	const float radiusA = sortedRadii[sorted];
+
+	for (int y = cellA.y - reach; y <= cellA.y + reach; ++y)
+	{
+		for (int x = cellA.x - reach; x <= cellA.x + reach; ++x)
+		{
+			Cell cell{ x, y };
+			uint32_t bucket = HashCell(cell);
+			for (int b = bucketStarts[bucket]; b < bucketStarts[bucket + 1]; ++b)
+			{
+				if (b == sorted || !(sortedCells[b] == cell))
+					continue;
+
+				Vec2 delta = sortedPositions[b] - positionA;
+				float distanceSqr = vec2::LengthSqr(delta);
+				float totalRadius = radiusA + sortedRadii[b];
+				if (distanceSqr <= totalRadius * totalRadius)
+					func(sortedItems[b], delta, distanceSqr);
+			}
+		}
+	}
+}
+
+// Each item only looks at items sorted after it so every pair is reported once.
+// Cells are at least as large as the largest diameter when sized by Build, so only the 3x3 neighborhood is visited.
+template <typename F>
+void SpatialIndex::ForEachOverlappingPair(F&& func) const
+{
+	const int reach = std::max(1, static_cast<int>(std::ceil(2.0f * maxRadius * inverseCellSize)));
+	const int count = static_cast<int>(sortedItems.size());
+
+	for (int a = 0; a < count; ++a)
+	{
+		Cell cellA = sortedCells[a];
+		Vec2 positionA = sortedPositions[a];
+		float radiusA = sortedRadii[a];
+
+		for (int y = cellA.y - reach; y <= cellA.y + reach; ++y)
+		{
+			for (int x = cellA.x - reach; x <= cellA.x + reach; ++x)
+			{
+				Cell cell{ x, y };
+				uint32_t bucket = HashCell(cell);
+				for (int b = std::max(a + 1, bucketStarts[bucket]); b < bucketStarts[bucket + 1]; ++b)
+				{
+					if (!(sortedCells[b] == cell))
+						continue;
+
+					Vec2 delta = sortedPositions[b] - positionA;
+					float distanceSqr = vec2::LengthSqr(delta);
+					float totalRadius = radiusA + sortedRadii[b];
+					if (distanceSqr <= totalRadius * totalRadius)
+						func(sortedItems[a], sortedItems[b], delta, distanceSqr);
+				}
+			}
+		}
+	}
+}
@@ -73,6 +73,7 @@ namespace math
 	constexpr float Log2E = std::numbers::log2e_v<float>;
 	constexpr float Log10E = std::numbers::log10e_v<float>;
 	constexpr float Phi = std::numbers::phi_v<float>; // Golden ratio
+	constexpr float DegToRad = Pi / 180.0f;
 
 	inline bool ApproxEqual(float a, float b)
 	{
@@ -407,6 +408,14 @@ namespace vec2
 		return Vec2{ std::fabs(v.x), std::fabs(v.y) };
 	}
 
+	// Rotation in degrees, matching Transform::rotation
+	inline Vec2 Rotate(const Vec2& v, float degrees)
+	{
+		float c = cosf(degrees * math::DegToRad);
+		float s = sinf(degrees * math::DegToRad);
+		return Vec2{ v.x * c - v.y * s, v.x * s + v.y * c };
+	}
+
 	inline std::pair<Vec2, Vec2> UnitVectors(const Vec2& v)
 	{
 		return { {v.x, 0}, {0, v.y} };
@@ -515,11 +524,14 @@ namespace camera
 
 struct GameTime
 {
-	GameTime(double elapsed, double delta) : elapsedSec(elapsed), deltaSec(delta) {}
+	GameTime(double elapsed, double delta, double alpha = 1.0) : elapsedSec(elapsed), deltaSec(delta), interpolationAlpha(alpha) {}
 	float t() const { return static_cast<float>(elapsedSec); }
 	float dt() const { return static_cast<float>(deltaSec); }
+	// How far the frame is between the last fixed simulation tick and the next one, renderers interpolate by it
+	float alpha() const { return static_cast<float>(interpolationAlpha); }
 private:
 	const double elapsedSec;
 	const double deltaSec;
+	const double interpolationAlpha;
 };
 